@@ -0,0 +1,90 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file activity_led.h
+///
+/// Pulse stretching for disk activity LEDs
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_ACTIVITY_LED
+#define INCLUDED_ACTIVITY_LED
+
+/////////////////////////////////////////////////////////////////////////////
+/// pulse stretching state machine for a single activity LED
+///
+/// The LED turns on as soon as a sample shows activity, stays on for at
+/// least MIN_ON_MS, and only turns off after IDLE_SAMPLES consecutive idle
+/// samples (hysteresis). Once off it stays off for at least MIN_OFF_MS.
+/// Sustained activity therefore shows as a steady light at low sampling
+/// rates, while a single short burst is still visible.
+class ActivityLed {
+public:
+	enum {
+		MIN_ON_MS		= 200,	///< minimum time the LED is lit
+		MIN_OFF_MS		= 100,	///< minimum time the LED is dark
+		IDLE_SAMPLES	= 2,	///< consecutive idle samples before turning off
+	};
+	
+	/// constructor
+	ActivityLed( )
+		:	lit_( false )
+		,	changed_ms_( 0 )
+		,	idle_samples_( 0 )
+	{ }
+	
+	/// is the LED lit?
+	bool Lit( ) const { return lit_; }
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// feed a new sample
+	/// @param busy Whether the sample showed any activity
+	/// @param now_ms Monotonic time of the sample in milliseconds
+	/// @return Whether the LED should now be lit
+	bool Update( bool busy, unsigned long long now_ms ) {
+		const unsigned long long elapsed = now_ms - changed_ms_;
+		
+		if ( busy ) {
+			idle_samples_ = 0;
+			if ( !lit_ && elapsed >= MIN_OFF_MS ) {
+				lit_ = true;
+				changed_ms_ = now_ms;
+			}
+		} else if ( lit_ ) {
+			if ( idle_samples_ < IDLE_SAMPLES ) ++idle_samples_;
+			if ( idle_samples_ >= IDLE_SAMPLES && elapsed >= MIN_ON_MS ) {
+				lit_ = false;
+				changed_ms_ = now_ms;
+			}
+		}
+		
+		return lit_;
+	}
+	
+private:
+	bool				lit_;			///< current LED state
+	unsigned long long	changed_ms_;	///< when the LED last changed state
+	unsigned int		idle_samples_;	///< consecutive idle samples seen while lit
+};
+
+#endif // INCLUDED_ACTIVITY_LED
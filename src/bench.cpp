@@ -0,0 +1,361 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file bench.cpp
+///
+/// Microbenchmarks of the daemon's hot paths
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+//- includes
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+
+#include "errno_exception.h"
+#include "device_monitor.h"
+#include "disk_stats.h"
+#include "led_acerh340.h"
+#include "led_compositor.h"
+#include "led_hpex485.h"
+#include "light_pattern.h"
+#include "port_io.h"
+#include "pwm_scheduler.h"
+#include "udev_attribute.h"
+#include <libudev.h>
+
+//- globals (as mediasmartserverd.cpp has them)
+int debug = 0;
+int verbose = 0;
+bool activity = false;
+int activity_interval = 250;
+int activity_idle_interval = 2000;
+double activity_backoff = 1.5;
+bool activity_intensity = false;
+bool update_native = false;
+
+/////////////////////////////////////////////////////////////////////////////
+// count heap allocations (libudev's included) by wrapping glibc's malloc
+static unsigned long long allocs = 0;	///< allocations so far
+
+extern "C" {
+void* __libc_malloc( size_t size );
+void* __libc_calloc( size_t cnt, size_t size );
+void* __libc_realloc( void* ptr, size_t size );
+
+void* malloc( size_t size ) { ++allocs; return __libc_malloc( size ); }
+void* calloc( size_t cnt, size_t size ) { ++allocs; return __libc_calloc( cnt, size ); }
+void* realloc( void* ptr, size_t size ) { ++allocs; return __libc_realloc( ptr, size ); }
+}
+
+/// somewhere for results to go so the work isn't optimised away
+static volatile unsigned long long sink = 0;
+
+/////////////////////////////////////////////////////////////////////////////
+/// port I/O that only counts, so the LED benchmarks time the drivers alone
+class CountingPortIo : public PortIo {
+public:
+	CountingPortIo( ) : accesses_( 0 ) { }
+	
+	virtual int Perm( unsigned long, unsigned long, int ) { return 0; }
+	virtual unsigned char InB( unsigned short ) { ++accesses_; return 0; }
+	virtual unsigned int InL( unsigned short ) { ++accesses_; return 0; }
+	virtual void OutB( unsigned char, unsigned short ) { ++accesses_; }
+	virtual void OutL( unsigned int, unsigned short ) { ++accesses_; }
+	
+	/// accesses so far
+	unsigned long long Accesses( ) const { return accesses_; }
+	
+private:
+	unsigned long long	accesses_;
+};
+static CountingPortIo counting_port_io;
+
+/// where the drivers are told the hardware is (InitCached skips probing)
+static const LedHwInfo BENCH_HW = { 0x1180, 0x0A00 };
+
+/////////////////////////////////////////////////////////////////////////////
+/// monotonic clock in nanoseconds
+static unsigned long long monotonic_ns( ) {
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return (unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// a benchmark: runs its operation cnt times
+class Bench {
+public:
+	virtual ~Bench( ) { }
+	virtual const char* Name( ) const = 0;
+	virtual void Run( unsigned long long cnt ) = 0;
+	
+	/// extra JSON fields about the last run (each starting with a comma)
+	virtual std::string Extra( ) const { return std::string( ); }
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// tokenising a line from a block device's stat file
+class BenchDiskStatsParse : public Bench {
+public:
+	BenchDiskStatsParse( )
+		:	line_( "  123456     2345  9876543    45678   234567    34567  8765432   567890        3   456789  1234567        0        0        0        0    12345     6789\n" )
+	{ }
+	const char* Name( ) const { return "disk_stats_parse"; }
+	void Run( unsigned long long cnt ) {
+		DiskStats stats;
+		for ( unsigned long long i = 0; i < cnt; ++i ) {
+			stats.Parse( line_.data(), line_.size() );
+			sink += stats.field[ DiskStats::IO_TICKS ];
+		}
+	}
+private:
+	std::string line_;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// finding a disk's bay from its sysfs path
+class BenchScsiHostIndex : public Bench, private DeviceMonitor {
+public:
+	BenchScsiHostIndex( ) {
+		// two controllers, as an H340 has them
+		bay_by_host_.assign( 6, -1 );
+		bay_by_host_[2] = 0; bay_by_host_[3] = 1; bay_by_host_[4] = 2; bay_by_host_[5] = 3;
+	}
+	const char* Name( ) const { return "scsi_host_index"; }
+	void Run( unsigned long long cnt ) {
+		static const char PATH[] = "/sys/devices/pci0000:00/0000:00:1f.2/ata4/host3/target3:0:0/3:0:0:0/block/sdb";
+		for ( unsigned long long i = 0; i < cnt; ++i ) sink += scsiHostIndex_( PATH );
+	}
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// switching bay LEDs on and off in turn (every call changes one), or
+/// setting them to what they already are (no call changes anything)
+template < typename Leds >
+class BenchLedSet : public Bench {
+public:
+	BenchLedSet( const char* name, bool changing ) : name_( name ), changing_( changing ) {
+		if ( !leds_.InitCached( BENCH_HW ) ) throw std::runtime_error( std::string( "Failed to initialise " ) + leds_.Desc( ) );
+	}
+	const char* Name( ) const { return name_; }
+	void Run( unsigned long long cnt ) {
+		for ( unsigned long long i = 0; i < cnt; ++i ) leds_.Set( LED_BLUE, i & 3, changing_ && ( i & 4 ) );
+	}
+private:
+	const char*	name_;
+	bool		changing_;
+	Leds		leds_;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// stepping a light show and committing its frames, like run_light_show
+class BenchLightShow : public Bench {
+public:
+	BenchLightShow( const char* name, int light_show )
+		:	name_( name )
+		,	compositor_( LedControlPtr( leds( ) ) )
+	{
+		pattern_.Compile( LightPattern::BuiltIn( light_show ) );
+	}
+	const char* Name( ) const { return name_; }
+	void Run( unsigned long long cnt ) {
+		for ( unsigned long long i = 0; i < cnt; ++i ) {
+			LedFrame frame;
+			int brightness = -1;
+			sink += pattern_.Run( frame, brightness );
+			if ( brightness >= 0 ) compositor_.SetBrightness( brightness );
+			if ( frame.bays ) {
+				compositor_.Publish( LAYER_OVERRIDE, frame );
+				compositor_.Commit( );
+			}
+		}
+	}
+private:
+	static LedControlBase* leds( ) {
+		LedAcerH340* leds = new LedAcerH340;
+		if ( !leds->InitCached( BENCH_HW ) ) throw std::runtime_error( std::string( "Failed to initialise " ) + leds->Desc( ) );
+		return leds;
+	}
+	
+	const char*		name_;
+	LedCompositor	compositor_;
+	LightPattern	pattern_;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// software PWM of every channel at assorted duty cycles, in real time
+///
+/// An operation is one timerfd wakeup. Besides the cost of each, this
+/// reports wakeups per second and how far the duty cycle each channel
+/// actually got (over whole periods) strays from the one asked for.
+class BenchPwm : public Bench {
+public:
+	BenchPwm( ) : wakeups_per_s_( 0 ), max_error_pct_( 0 ) { }
+	const char* Name( ) const { return "pwm_schedule"; }
+	void Run( unsigned long long cnt ) {
+		static const unsigned int DUTY[PwmScheduler::MAX_CHANNELS] = { 13, 40, 64, 100, 128, 180, 230, 250 };
+		
+		PwmScheduler pwm;
+		for ( size_t i = 0; i < PwmScheduler::MAX_CHANNELS; ++i ) pwm.SetDuty( i, DUTY[i] );
+		pwm.Sync( );
+		
+		unsigned long long lit_ns[PwmScheduler::MAX_CHANNELS] = { 0 };
+		unsigned long long whole_lit_ns[PwmScheduler::MAX_CHANNELS] = { 0 };
+		const unsigned long long start_ns = monotonic_ns( );
+		unsigned long long last_ns = start_ns, first_period_ns = 0, whole_end_ns = 0;
+		
+		for ( unsigned long long i = 0; i < cnt; ++i ) {
+			struct pollfd pfd = { pwm.Fd( ), POLLIN, 0 };
+			if ( poll( &pfd, 1, -1 ) < 0 ) throw ErrnoException( "poll" );
+			
+			const unsigned long long now_ns = monotonic_ns( );
+			const unsigned int before = pwm.Lit( );
+			for ( size_t ch = 0; ch < PwmScheduler::MAX_CHANNELS; ++ch ) {
+				if ( before & ( 1U << ch ) ) lit_ns[ch] += now_ns - last_ns;
+			}
+			last_ns = now_ns;
+			pwm.Expired( );
+			
+			// only periods start by turning channels on: keep totals at each
+			if ( pwm.Lit( ) & ~before ) {
+				if ( !first_period_ns ) {
+					first_period_ns = now_ns;
+					std::fill( lit_ns, lit_ns + PwmScheduler::MAX_CHANNELS, 0 );
+				}
+				std::copy( lit_ns, lit_ns + PwmScheduler::MAX_CHANNELS, whole_lit_ns );
+				whole_end_ns = now_ns;
+			}
+		}
+		
+		wakeups_per_s_ = cnt * 1e9 / ( last_ns - start_ns );
+		max_error_pct_ = 0;
+		if ( whole_end_ns <= first_period_ns ) return;
+		for ( size_t ch = 0; ch < PwmScheduler::MAX_CHANNELS; ++ch ) {
+			const double achieved = (double)whole_lit_ns[ch] / ( whole_end_ns - first_period_ns );
+			const double requested = (double)DUTY[ch] / PwmScheduler::DUTY_MAX;
+			max_error_pct_ = std::max( max_error_pct_, 100 * fabs( achieved - requested ) );
+		}
+	}
+	std::string Extra( ) const {
+		char extra[96];
+		snprintf( extra, sizeof(extra), ",\"wakeups_per_s\":%.1f,\"max_duty_error_pct\":%.2f", wakeups_per_s_, max_error_pct_ );
+		return extra;
+	}
+private:
+	double	wakeups_per_s_;		///< over the last run
+	double	max_error_pct_;		///< worst channel's achieved duty minus requested, in points
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// reading a device attribute the way board detection reads DMI ones
+///
+/// DMI isn't there in containers, so this reads /sys/class/mem/null/dev,
+/// which every Linux box has, to always time the found path.
+class BenchUdevAttribute : public Bench {
+public:
+	BenchUdevAttribute( ) : udev_( udev_new( ) ) {
+		if ( !udev_ ) throw ErrnoException( "udev_new" );
+		if ( GetUdevDeviceAttribute( udev_, "mem", "null", "dev" ).empty() ) {
+			udev_unref( udev_ );
+			throw std::runtime_error( "udev_attribute: no dev attribute for /sys/class/mem/null" );
+		}
+	}
+	~BenchUdevAttribute( ) { udev_unref( udev_ ); }
+	const char* Name( ) const { return "udev_attribute"; }
+	void Run( unsigned long long cnt ) {
+		for ( unsigned long long i = 0; i < cnt; ++i ) {
+			sink += GetUdevDeviceAttribute( udev_, "mem", "null", "dev" ).size();
+		}
+	}
+private:
+	udev*	udev_;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// time a benchmark and print one line of JSON about it
+/// @param min_ns Keep doubling the iterations until a run takes this long
+static void run_bench( Bench& bench, unsigned long long min_ns ) {
+	bench.Run( 1 ); // warm up (and take any one-off allocations)
+	
+	for ( unsigned long long cnt = 1; ; cnt *= 2 ) {
+		const unsigned long long allocs_before = allocs;
+		const unsigned long long ports_before = counting_port_io.Accesses( );
+		const unsigned long long start_ns = monotonic_ns( );
+		bench.Run( cnt );
+		const unsigned long long elapsed_ns = monotonic_ns( ) - start_ns;
+		if ( elapsed_ns < min_ns ) continue;
+		
+		printf( "{\"name\":\"%s\",\"iterations\":%llu,\"ns_per_op\":%.2f,\"allocs_per_op\":%.2f,\"port_ops_per_op\":%.2f%s}\n",
+			bench.Name( ), cnt, (double)elapsed_ns / cnt,
+			(double)( allocs - allocs_before ) / cnt, (double)( counting_port_io.Accesses( ) - ports_before ) / cnt,
+			bench.Extra( ).c_str( ) );
+		fflush( stdout );
+		return;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// main entry point
+///
+/// Runs every benchmark, or just those named on the command line, printing
+/// a line of JSON per benchmark.
+int main( int argc, char* argv[] ) try {
+	port_io = &counting_port_io;
+	
+	BenchDiskStatsParse					disk_stats_parse;
+	BenchScsiHostIndex					scsi_host_index;
+	BenchLedSet< LedAcerH340 >			led_set_h340( "led_set_h340", true );
+	BenchLedSet< LedAcerH340 >			led_set_noop_h340( "led_set_noop_h340", false );
+	BenchLedSet< LedHpEx48X >			led_set_ex48x( "led_set_ex48x", true );
+	BenchLedSet< LedHpEx48X >			led_set_noop_ex48x( "led_set_noop_ex48x", false );
+	BenchLightShow						light_show_random( "light_show_random", 1 );
+	BenchLightShow						light_show_sweep( "light_show_sweep", 4 );
+	BenchPwm							pwm_schedule;
+	BenchUdevAttribute					udev_attribute;
+	
+	Bench* const BENCHES[] = {
+		&disk_stats_parse, &scsi_host_index, &led_set_h340, &led_set_noop_h340, &led_set_ex48x, &led_set_noop_ex48x,
+		&light_show_random, &light_show_sweep, &pwm_schedule, &udev_attribute,
+	};
+	
+	for ( size_t i = 0; i < sizeof(BENCHES) / sizeof(BENCHES[0]); ++i ) {
+		bool wanted = ( argc < 2 );
+		for ( int arg = 1; arg < argc; ++arg ) wanted = wanted || 0 == strcmp( argv[arg], BENCHES[i]->Name( ) );
+		if ( wanted ) run_bench( *BENCHES[i], 200000000ULL );
+	}
+	
+	return 0;
+	
+} catch ( std::exception& e ) {
+	std::cerr << e.what() << '\n';
+	return 1;
+}
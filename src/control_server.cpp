@@ -0,0 +1,321 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file control_server.cpp
+///
+/// Unix domain socket for controlling the LEDs of a running daemon
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+//- includes
+#include "control_server.h"
+#include "errno_exception.h"
+#include <iostream>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+/////////////////////////////////////////////////////////////////////////////
+/// fill in a unix socket address
+static bool make_address( const char* path, sockaddr_un& addr ) {
+	memset( &addr, 0, sizeof(addr) );
+	addr.sun_family = AF_UNIX;
+	if ( strlen( path ) >= sizeof(addr.sun_path) ) return false;
+	strcpy( addr.sun_path, path );
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// send a batch of commands to a running daemon
+bool control_request( const char* path, const ControlCmd* cmds, size_t cnt, ControlState& state ) {
+	sockaddr_un addr;
+	if ( !make_address( path, addr ) ) return false;
+	
+	const int fd = socket( AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0 );
+	if ( -1 == fd ) throw ErrnoException( "socket" );
+	
+	// nobody home?
+	if ( -1 == connect( fd, (const sockaddr*)&addr, sizeof(addr) ) ) {
+		close( fd );
+		return false;
+	}
+	
+	// don't hang about if the daemon is wedged
+	const timeval timeout = { 2, 0 };
+	setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout) );
+	
+	const ssize_t len = cnt * sizeof(ControlCmd);
+	if ( send( fd, cmds, len, MSG_NOSIGNAL ) != len ) {
+		const int err = errno;
+		close( fd );
+		errno = err;
+		throw ErrnoException( "send(control)" );
+	}
+	
+	memset( &state, 0, sizeof(state) );
+	const ssize_t got = recv( fd, &state, sizeof(state), 0 );
+	const int err = errno;
+	close( fd );
+	
+	if ( got == sizeof(state) && CTL_TOO_MANY == state.op ) {
+		errno = E2BIG;
+		throw ErrnoException( "control batch" );
+	}
+	if ( got != sizeof(state) || CTL_STATE != state.op ) {
+		errno = ( -1 == got ) ? err : EPROTO;
+		throw ErrnoException( "recv(control)" );
+	}
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// constructor
+ControlServer::ControlServer( const LedCompositorPtr& compositor, const LedFrame& overrides )
+	:	compositor_( compositor )
+	,	overrides_( overrides )
+	,	loop_( 0 )
+	,	listen_fd_( -1 )
+	,	generation_( 0 )
+	,	brightness_( -1 )
+	,	usb_( -1 )
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// destructor
+ControlServer::~ControlServer( ) {
+	while ( !clients_.empty() ) drop_( clients_.size() - 1 );
+	
+	if ( -1 != listen_fd_ ) {
+		loop_->Remove( listen_fd_ );
+		close( listen_fd_ );
+		unlink( path_.c_str() );
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// start listening, replacing a stale socket
+bool ControlServer::Listen( const char* path, EventLoop& loop ) {
+	sockaddr_un addr;
+	if ( !make_address( path, addr ) ) {
+		std::cout << "Control socket path too long: " << path << '\n';
+		return false;
+	}
+	
+	const int fd = socket( AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0 );
+	if ( -1 == fd ) throw ErrnoException( "socket" );
+	
+	// only root gets to play with the LEDs, from the moment the socket exists
+	const mode_t old_umask = umask( S_IXUSR | S_IRWXG | S_IRWXO );
+	int ret = bind( fd, (const sockaddr*)&addr, sizeof(addr) );
+	if ( -1 == ret && EADDRINUSE == errno ) {
+		// left behind by a daemon that died, or is somebody still using it?
+		const int probe = socket( AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0 );
+		const bool in_use = ( -1 != probe && 0 == connect( probe, (const sockaddr*)&addr, sizeof(addr) ) );
+		if ( -1 != probe ) close( probe );
+		
+		if ( in_use ) {
+			std::cout << "Control socket " << path << " is in use by another daemon\n";
+			umask( old_umask );
+			close( fd );
+			return false;
+		}
+		
+		unlink( path );
+		ret = bind( fd, (const sockaddr*)&addr, sizeof(addr) );
+	}
+	const int err = errno;
+	umask( old_umask );
+	errno = err;
+	
+	if ( -1 == ret || -1 == listen( fd, 4 ) ) {
+		std::cout << "Control socket " << path << ": " << strerror( errno ) << ", carrying on without it\n";
+		close( fd );
+		return false;
+	}
+	
+	listen_fd_ = fd;
+	path_ = path;
+	loop_ = &loop;
+	loop_->Add( listen_fd_, this, "control" );
+	loop_->AddBeforeWait( this );
+	generation_ = compositor_->Generation( );
+	
+	// put the initial overrides up (xmas, locate)
+	compositor_->Publish( LAYER_OVERRIDE, overrides_ );
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// one of our sockets is readable
+void ControlServer::OnEvent( int fd, unsigned int /*events*/ ) {
+	if ( fd == listen_fd_ ) {
+		accept_( );
+		return;
+	}
+	
+	// a request, or the connection closing
+	for ( size_t i = 0; i < clients_.size(); ++i ) {
+		if ( clients_[i].fd != fd ) continue;
+		if ( !request_( clients_[i] ) ) drop_( i );
+		return;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// tell subscribers if the LEDs changed
+void ControlServer::Notify( ) {
+	const unsigned long long generation = compositor_->Generation( );
+	if ( generation == generation_ ) return;
+	generation_ = generation;
+	
+	const ControlState state = state_( );
+	for ( size_t i = 0; i < clients_.size(); ++i ) {
+		// a subscriber too slow to keep up just misses changes
+		if ( clients_[i].subscribed ) send( clients_[i].fd, &state, sizeof(state), MSG_DONTWAIT | MSG_NOSIGNAL );
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// take on new connections
+void ControlServer::accept_( ) {
+	for ( ;; ) {
+		const int fd = accept4( listen_fd_, 0, 0, SOCK_CLOEXEC | SOCK_NONBLOCK );
+		if ( -1 == fd ) return;
+		
+		// don't let clients pile up without bound
+		if ( clients_.size() >= CTL_MAX_CLIENTS ) {
+			close( fd );
+			continue;
+		}
+		
+		Client client = { fd, false };
+		clients_.push_back( client );
+		loop_->Add( fd, this, "control" );
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// close a connection
+void ControlServer::drop_( size_t idx ) {
+	loop_->Remove( clients_[idx].fd );
+	close( clients_[idx].fd );
+	clients_.erase( clients_.begin() + idx );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// apply a batch of commands and reply with the state
+/// @return false if the connection is finished with
+bool ControlServer::request_( Client& client ) {
+	ControlCmd cmds[CTL_MAX_CMDS];
+	iovec iov = { cmds, sizeof(cmds) };
+	msghdr msg;
+	memset( &msg, 0, sizeof(msg) );
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	
+	const ssize_t len = recvmsg( client.fd, &msg, 0 );
+	if ( -1 == len ) return ( EAGAIN == errno || EINTR == errno );
+	if ( 0 == len ) return false;
+	
+	// half a batch is worse than none: say so and leave the LEDs alone
+	if ( msg.msg_flags & MSG_TRUNC ) {
+		ControlState state = state_( );
+		state.op = CTL_TOO_MANY;
+		return sizeof(state) == send( client.fd, &state, sizeof(state), MSG_DONTWAIT | MSG_NOSIGNAL );
+	}
+	
+	bool touched = false;
+	for ( size_t i = 0; i < len / sizeof(ControlCmd); ++i ) {
+		const ControlCmd& cmd = cmds[i];
+		switch ( cmd.op ) {
+		case CTL_SET_BAY:
+			overrides_.SetBay( cmd.a, cmd.b & ( LED_BLUE | LED_RED ) );
+			overrides_.SetBayBlink( cmd.a, cmd.c & ( LED_BLUE | LED_RED ) );
+			touched = true;
+			break;
+		
+		case CTL_SET_SYSTEM:
+			if ( LED_OFF != cmd.b && LED_ON != cmd.b && LED_BLINK != cmd.b ) break;
+			overrides_.SetSystem( cmd.a & ( LED_BLUE | LED_RED ), (LedState)cmd.b );
+			touched = true;
+			break;
+		
+		case CTL_RELEASE:
+			overrides_ = LedFrame( );
+			touched = true;
+			break;
+		
+		case CTL_BRIGHTNESS:
+			compositor_->SetBrightness( cmd.a );
+			brightness_ = cmd.a;
+			break;
+		
+		case CTL_USB:
+			compositor_->MountUsb( 0 != cmd.a );
+			usb_ = ( 0 != cmd.a );
+			break;
+		
+		case CTL_SUBSCRIBE:
+			client.subscribed = true;
+			break;
+		
+		default:
+			break;
+		}
+	}
+	
+	// the whole batch goes out together
+	if ( touched ) {
+		compositor_->Publish( LAYER_OVERRIDE, overrides_ );
+		compositor_->Commit( );
+	}
+	
+	const ControlState state = state_( );
+	return sizeof(state) == send( client.fd, &state, sizeof(state), MSG_DONTWAIT | MSG_NOSIGNAL );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// state of the LEDs as sent to clients
+ControlState ControlServer::state_( ) const {
+	const LedFrame output = compositor_->Output( );
+	
+	ControlState state;
+	memset( &state, 0, sizeof(state) );
+	state.op			= CTL_STATE;
+	state.brightness	= ( brightness_ < 0 ) ? 0xFF : brightness_;
+	state.usb			= ( usb_ < 0 ) ? 0xFF : usb_;
+	state.bays			= LedFrame::MAX_BAYS;
+	state.system_on		= output.system_on;
+	state.system_blink	= output.system_blink;
+	for ( size_t i = 0; i < LedFrame::MAX_BAYS; ++i ) {
+		state.bay[i]		= output.bay[i];
+		state.bay_blink[i]	= output.bay_blink[i];
+	}
+	return state;
+}
@@ -0,0 +1,139 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file control_server.h
+///
+/// Unix domain socket for controlling the LEDs of a running daemon
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_CONTROL_SERVER
+#define INCLUDED_CONTROL_SERVER
+
+//- includes
+#include "event_loop.h"
+#include "led_compositor.h"
+#include <string>
+#include <vector>
+
+/////////////////////////////////////////////////////////////////////////////
+/// control protocol
+///
+/// Each SOCK_SEQPACKET message is a batch of 4 byte commands, applied in
+/// order and committed to the LEDs in one go. Every message is answered
+/// with a ControlState reflecting the LEDs afterwards. A batch of more than
+/// CTL_MAX_CMDS is rejected whole, with op CTL_TOO_MANY in the reply.
+enum ControlOp {
+	CTL_NOP			= 0,	///< nothing
+	CTL_SET_BAY,			///< a = bay, b = colours lit, c = colours blinking
+	CTL_SET_SYSTEM,			///< a = colours, b = LedState
+	CTL_RELEASE,			///< drop every LED set over the socket
+	CTL_BRIGHTNESS,			///< a = brightness
+	CTL_USB,				///< a = mount (1) or unmount (0)
+	CTL_QUERY,				///< just reply with the state
+	CTL_SUBSCRIBE,			///< also send the state whenever the LEDs change
+	CTL_STATE,				///< state of the LEDs (ControlState)
+	CTL_TOO_MANY,			///< batch over CTL_MAX_CMDS, ignored (ControlState)
+};
+
+/// a single command
+struct ControlCmd {
+	unsigned char	op;		///< ControlOp
+	unsigned char	a;
+	unsigned char	b;
+	unsigned char	c;
+};
+
+/// state of the LEDs as sent to clients
+struct ControlState {
+	unsigned char	op;							///< CTL_STATE
+	unsigned char	brightness;					///< last brightness set (0xFF if never)
+	unsigned char	usb;						///< last USB state set (0xFF if never)
+	unsigned char	bays;						///< entries in bay[]
+	unsigned char	system_on;					///< system LED colours lit
+	unsigned char	system_blink;				///< system LED colours blinking
+	unsigned char	bay[LedFrame::MAX_BAYS];		///< colours lit per bay
+	unsigned char	bay_blink[LedFrame::MAX_BAYS];	///< colours blinking per bay
+};
+
+enum {
+	CTL_MAX_CMDS	= 64,	///< most commands in a single message
+	CTL_MAX_CLIENTS	= 64,	///< most connections at once
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// send a batch of commands to a running daemon
+/// @param path Control socket
+/// @param state Receives the reply
+/// @return false if there's no daemon listening
+bool control_request( const char* path, const ControlCmd* cmds, size_t cnt, ControlState& state );
+
+/////////////////////////////////////////////////////////////////////////////
+/// control socket of a running daemon
+///
+/// LEDs set over the socket go in the compositor's override layer, so
+/// they sit on top of everything else until released.
+class ControlServer : public EventHandler {
+public:
+	/// constructor
+	/// @param overrides Initial contents of the override layer
+	ControlServer( const LedCompositorPtr& compositor, const LedFrame& overrides );
+	~ControlServer( );
+	
+	/// start listening (on loop), replacing a stale socket
+	/// @return false (having said why) if we can't
+	bool Listen( const char* path, EventLoop& loop );
+	
+	/// tell subscribers if the LEDs changed
+	void Notify( );
+	
+	virtual void OnEvent( int fd, unsigned int events );
+	virtual void BeforeWait( ) { Notify( ); }
+	
+private:
+	struct Client {
+		int		fd;			///< connection
+		bool	subscribed;	///< wants every change?
+	};
+	
+	void accept_( );
+	void drop_( size_t idx );
+	bool request_( Client& client );
+	ControlState state_( ) const;
+	
+	LedCompositorPtr		compositor_;	///< where LED changes go
+	LedFrame				overrides_;		///< override layer
+	EventLoop*				loop_;			///< where our sockets are watched
+	int						listen_fd_;		///< listening socket
+	std::string				path_;			///< where it is
+	std::vector< Client >	clients_;		///< connections
+	unsigned long long		generation_;	///< compositor output last sent to subscribers
+	int						brightness_;	///< last brightness set (-1 if never)
+	int						usb_;			///< last USB state set (-1 if never)
+	
+	// no copying
+	ControlServer( const ControlServer& rhs );
+	const ControlServer& operator=( const ControlServer& rhs );
+};
+
+#endif // INCLUDED_CONTROL_SERVER
@@ -31,37 +31,65 @@
 //- includes
 #include "device_monitor.h"
 #include "errno_exception.h"
+#include "loop_profile.h"
 #include "mediasmartserverd.h"
 #include <iostream>
+#include <map>
+#include <algorithm>
 #include <assert.h>
-#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <string>
-#include <fstream>
+#include <time.h>
+#include <unistd.h>
 extern "C" {
 #include <libudev.h>
 }
 
+/////////////////////////////////////////////////////////////////////////////
+/// monotonic clock in milliseconds
+static unsigned long long monotonic_ms( ) {
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return (unsigned long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// monotonic clock in microseconds
+static unsigned long long monotonic_us( ) {
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
+
 /////////////////////////////////////////////////////////////////////////////
 /// constructor
 DeviceMonitor::DeviceMonitor( )
-        :       dev_context_( 0 )
+	:	dev_context_( 0 )
 	,	dev_monitor_( 0 )
-	,	num_disks_( 0 )
+	,	last_sample_ms_( 0 )
+	,	interval_( activity_interval )
+	,	metrics_( 0 )
+	,	sampled_( false )
+	,	woken_us_( 0 )
+	,	generation_( 0 )
 { 
 }
 	
 /////////////////////////////////////////////////////////////////////////////
 /// destructor
 DeviceMonitor::~DeviceMonitor( ) {
+	for ( size_t i = 0; i < disk_fd_.size(); ++i ) close( disk_fd_[i] );
 	if ( dev_context_ ) udev_unref( dev_context_ );
 	if ( dev_monitor_ ) udev_monitor_unref( dev_monitor_ );
 }
 
 /////////////////////////////////////////////////////////////////////////////
 /// intialise
-void DeviceMonitor::Init( const LedControlPtr& leds ) {
-	leds_ = leds;
+void DeviceMonitor::Init( const LedCompositorPtr& compositor ) {
+	compositor_ = compositor;
 	
 	// get udev library context
 	dev_context_ = udev_new();
@@ -71,12 +99,18 @@ void DeviceMonitor::Init( const LedControlPtr& leds ) {
 	dev_monitor_ = udev_monitor_new_from_netlink( dev_context_, "udev" );
 	if ( !dev_monitor_ ) throw ErrnoException( "udev_monitor_new_from_netlink" );
 	
-	// only interested in scsi devices
-	if ( udev_monitor_filter_add_match_subsystem_devtype( dev_monitor_, "scsi", "scsi_device" ) ) {
+	// only interested in whole disks (acceptDevice_ narrows it down to ata)
+	if ( udev_monitor_filter_add_match_subsystem_devtype( dev_monitor_, "block", "disk" ) ) {
+		throw ErrnoException( "udev_monitor_filter_add_match_subsystem_devtype" );
+	}
+	
+	// and changes to scsi hosts (which decide the bay numbering)
+	if ( udev_monitor_filter_add_match_subsystem_devtype( dev_monitor_, "scsi_host", 0 ) ) {
 		throw ErrnoException( "udev_monitor_filter_add_match_subsystem_devtype" );
 	}
 	
-	// enumerate existing devices
+	// work out the bay numbering then enumerate existing devices
+	scanScsiHosts_( );
 	enumDevices_( );
 	
 	// then start monitoring
@@ -86,117 +120,266 @@ void DeviceMonitor::Init( const LedControlPtr& leds ) {
 }
 
 /////////////////////////////////////////////////////////////////////////////
-/// main looop
-void DeviceMonitor::Main( ) {
+/// start handling events from the loop
+void DeviceMonitor::Attach( EventLoop& loop ) {
 	assert( dev_monitor_ );
 	
-	const int fd_mon = udev_monitor_get_fd( dev_monitor_ );
-	const int nfds = fd_mon + 1;
-        int queue_tok = 8;
-	
-	sigset_t sigempty;
-	sigemptyset( &sigempty );
+	loop.Add( udev_monitor_get_fd( dev_monitor_ ), this, "udev" );
+	loop.Add( pwm_.Fd( ), this, "pwm" );
+	loop.Add( blinker_.Fd( ), this, "blink" );
+	if ( activity || metrics_ ) {
+		ticker_.Start( interval_ );
+		loop.Add( ticker_.Fd( ), this, "activity" );
+	}
+	loop.AddBeforeWait( this );
+}
 
-        struct timespec timeout;
+/////////////////////////////////////////////////////////////////////////////
+/// print activity sampling stats
+void DeviceMonitor::Report( ) const {
+	if ( !activity ) return;
+	ticker_.Report( "activity" );
+	ticker_.ReportHistogram( "activity" );
+}
 
-        if( activity )
-        {
-            timeout.tv_sec = 0;
-            //timeout.tv_sec = 1;
-            timeout.tv_nsec = 100000000;
-            //timeout.tv_nsec = 0;
-        }
-        else
-        {
-            timeout.tv_sec = 999;
-            timeout.tv_nsec = 0;
-        }
+/////////////////////////////////////////////////////////////////////////////
+/// write out whatever the last round of events changed
+void DeviceMonitor::BeforeWait( ) {
+	if ( !compositor_ ) return;
+	compositor_->Commit( );
+	
+	// how long what woke us took to reach the LEDs (if it changed any)
+	if ( generation_ != compositor_->Generation( ) ) {
+		generation_ = compositor_->Generation( );
+		if ( woken_us_ ) LoopProfile::Record( loop_profile.event_to_led_us, monotonic_us( ) - woken_us_ );
+	}
+	woken_us_ = 0;
+	
+	// once per sample, with the LEDs as just written
+	if ( metrics_ && sampled_ ) {
+		renderMetrics_( );
+		sampled_ = false;
+	}
+	
+	// the blinker only runs while LEDs the hardware can't blink are blinking
+	const int blink_ms = compositor_->SoftBlinkInterval( );
+	if ( blink_ms && !blinker_.Running( ) ) blinker_.Start( blink_ms );
+	if ( !blink_ms && blinker_.Running( ) ) blinker_.Stop( );
+}
 
-	while ( true ) {
-		fd_set fds_read;
-		FD_ZERO( &fds_read );
-		FD_SET( fd_mon, &fds_read );
+/////////////////////////////////////////////////////////////////////////////
+/// one of our file descriptors is ready
+void DeviceMonitor::OnEvent( int fd, unsigned int /*events*/ ) {
+	const unsigned long long now_us = monotonic_us( );
+	if ( !woken_us_ ) woken_us_ = now_us;
+	
+	// udev monitor notification?
+	if ( fd == udev_monitor_get_fd( dev_monitor_ ) ) {
+		++loop_profile.udev_events;
+		deviceEvent_( );
 		
-		// block for something interesting to happen
-		int res = pselect( nfds, &fds_read, 0, 0, &timeout, &sigempty );
-		if ( res < 0 ) {
-			if ( EINTR != errno ) throw ErrnoException( "select" );
-			std::cout << "Exiting on signal\n";
-			return; // signalled
-		}
+	// time to sample disk activity?
+	} else if ( fd == ticker_.Fd( ) ) {
+		if ( !ticker_.Expired( ) ) return;
+		interval_ = sampleActivity_( interval_ );
+		ticker_.SetPeriod( interval_ );
+		++loop_profile.ticks;
+		LoopProfile::Record( loop_profile.tick_us, monotonic_us( ) - now_us );
 		
-		// udev monitor notification?
-		if ( FD_ISSET( fd_mon, &fds_read ) ) {
-			std::tr1::shared_ptr< udev_device > device( udev_monitor_receive_device( dev_monitor_ ), &udev_device_unref );
-                        // make sure this is a device we want to monitor
-			if (!acceptDevice_(device.get())) continue;
-	
-			const char* str = udev_device_get_action( device.get() );
-			if ( !str ) {
-			} else if ( 0 == strcasecmp( str, "add" ) ) {
-				deviceAdded_( device.get() );
-			} else if ( 0 == strcasecmp( str, "remove" ) ) {
-				deviceRemove_( device.get() );
-			} else {
-				if ( debug ) {
-					std::cout << "action: " << str << '\n';
-					std::cout << ' ' << udev_device_get_syspath(device.get()) << "' (" << udev_device_get_subsystem(device.get()) << ")\n";
-				}
-			}
+		if ( debug ) {
+			std::cout << " (" << interval_ << "ms, " << ticker_.Lateness( ) << "us late)\n";
+			if ( 0 == ticker_.Ticks( ) % 100 ) ticker_.Report( "activity" );
 		}
+		
+	// PWM edges due?
+	} else if ( fd == pwm_.Fd( ) ) {
+		if ( pwm_.Expired( ) ) publishActivity_( );
+		
+	// time to toggle software blinking?
+	} else if ( fd == blinker_.Fd( ) ) {
+		if ( blinker_.Expired( ) && compositor_ ) compositor_->BlinkTick( );
+	}
+}
 
-                if( activity )
-                {
-                    for( int i = 0; i < num_disks_; ++i )
-                    {
-                        std::ifstream stats;
-                        stats.open( statsFile(i).c_str() );
-
-                        char buf[256];
-                        stats.getline( &(buf[0]), 255 );
-                        std::string s(&(buf[0]));
-
-                        // tokenize the string
-                        std::string::size_type last = s.find_first_not_of( " ", 0 );
-                        std::string::size_type pos = s.find_first_of( " ", last );
+/////////////////////////////////////////////////////////////////////////////
+/// handle a udev monitor notification
+void DeviceMonitor::deviceEvent_( ) {
+	std::tr1::shared_ptr< udev_device > device( udev_monitor_receive_device( dev_monitor_ ), &udev_device_unref );
+	const char* subsystem = ( device ) ? udev_device_get_subsystem( device.get() ) : 0;
+	
+	// make sure this is a device we want to monitor
+	const char* str = ( device && acceptDevice_(device.get()) ) ? udev_device_get_action( device.get() ) : 0;
+	if ( subsystem && 0 == strcmp( subsystem, "scsi_host" ) ) {
+		if ( debug ) std::cout << "scsi_host " << udev_device_get_action( device.get() ) << ": " << udev_device_get_syspath( device.get() ) << '\n';
+		scanScsiHosts_( );
+	} else if ( !str ) {
+	} else if ( 0 == strcasecmp( str, "add" ) ) {
+		deviceAdded_( device.get() );
+	} else if ( 0 == strcasecmp( str, "remove" ) ) {
+		deviceRemove_( device.get() );
+	} else {
+		if ( debug ) {
+			std::cout << "action: " << str << '\n';
+			std::cout << ' ' << udev_device_get_syspath(device.get()) << "' (" << udev_device_get_subsystem(device.get()) << ")\n";
+		}
+	}
+}
 
-                        int tok = 0;
-                        int queue_length = 0;
-                        while( std::string::npos != pos || std::string::npos != last )
-                        {
-                            last = s.find_first_not_of(" ", pos );
-                            pos = s.find_first_of( " ", last );
-                            ++tok;
+/////////////////////////////////////////////////////////////////////////////
+/// sample disk activity and update the bay LEDs
+/// @param interval Current sampling interval (ms)
+/// @return Interval until the next sample (ms)
+int DeviceMonitor::sampleActivity_( int interval ) {
+	const unsigned long long now_ms = monotonic_ms( );
+	const unsigned long long elapsed_ms = ( last_sample_ms_ ) ? now_ms - last_sample_ms_ : interval;
+	last_sample_ms_ = now_ms;
+	
+	bool idle = true;
+	activity_ = LedFrame( );
+	const size_t num_disks = disk_fd_.size();
+	for ( size_t i = 0; i < num_disks; ++i ) {
+		DiskStats sample;
+		++loop_profile.sysfs_reads;
+		if ( !sample.Read( disk_fd_[i] ) ) continue;
+		
+		DiskActivity act;
+		act.Update( disk_stats_[i], sample );
+		disk_stats_[i] = sample;
+		disk_util_[i] = ( elapsed_ms ) ? std::min( 1.0f, (float)act.io_ticks / elapsed_ms ) : 0.0f;
+		if ( act.Busy() ) idle = false;
+		
+		if ( debug ) std::cout << " " << i << " r" << act.reads << " w" << act.writes << " q" << act.in_flight;
+		
+		// only sampling for the metrics?
+		if ( !activity ) continue;
+		
+		// reads light blue, writes light red (both show purple)
+		bool reading = act.Reading();
+		bool writing = act.Writing();
+		if ( !reading && !writing && act.Busy() ) {
+			// I/O in progress that hasn't completed yet
+			reading = writing = true;
+		}
+		activity_.SetBay( disk_led_[i],
+			( disk_read_led_[i].Update( reading, now_ms )  ? LED_BLUE : 0 ) |
+			( disk_write_led_[i].Update( writing, now_ms ) ? LED_RED  : 0 )
+		);
+		if ( disk_read_led_[i].Lit() || disk_write_led_[i].Lit() ) idle = false;
+		
+		if ( activity_intensity ) {
+			// duty cycle follows the share of time spent doing I/O, never
+			// dimmer than a single slot so any activity still shows (rounded
+			// up, as a slot is 25.6 and 25 would quantise to none at first)
+			const unsigned int min_duty = ( PwmScheduler::DUTY_MAX + PwmScheduler::SLOTS - 1 ) / PwmScheduler::SLOTS;
+			const unsigned int util = ( elapsed_ms )
+				?	std::min<unsigned long long>( act.io_ticks * PwmScheduler::DUTY_MAX / elapsed_ms, PwmScheduler::DUTY_MAX )
+				:	(unsigned long long)PwmScheduler::DUTY_MAX;
+			pwm_.SetDuty( disk_led_[i], ( activity_.bay[ disk_led_[i] ] ) ? std::max( util, min_duty ) : 0 );
+		}
+	}
+	if ( activity_intensity ) pwm_.Sync( );
+	sampled_ = true;
+	
+	// all bays in one go
+	if ( activity ) publishActivity_( );
+	
+	// snap back to the fast rate on any activity, otherwise back off
+	return ( idle )
+		?	std::min( activity_idle_interval, std::max( interval + 1, (int)( interval * activity_backoff ) ) )
+		:	activity_interval;
+}
 
-                            if( tok == queue_tok )
-                            {
-                                queue_length = atoi(s.substr( last, pos - last ).c_str());
-                                if( debug )
-                                    std::cout << " " << i << " " << queue_length;
-                                break;
-                            }
-                        }
+/////////////////////////////////////////////////////////////////////////////
+/// publish the activity layer (with bays PWM has dimmed turned off)
+void DeviceMonitor::publishActivity_( ) {
+	if ( !compositor_ ) return;
+	if ( !activity_intensity ) {
+		compositor_->Publish( LAYER_ACTIVITY, activity_ );
+		return;
+	}
+	
+	LedFrame frame = activity_;
+	for ( size_t i = 0; i < LedFrame::MAX_BAYS; ++i ) {
+		if ( !( pwm_.Lit( ) & ( 1U << i ) ) ) frame.bay[i] = 0;
+	}
+	compositor_->Publish( LAYER_ACTIVITY, frame );
+}
 
-                        int led_idx = ledIndex(i);
+/////////////////////////////////////////////////////////////////////////////
+/// append a formatted line to a metrics page
+static void metric( std::string& page, const char* fmt, ... ) __attribute__(( format( printf, 2, 3 ) ));
+static void metric( std::string& page, const char* fmt, ... ) {
+	char line[256];
+	va_list args;
+	va_start( args, fmt );
+	const int len = vsnprintf( line, sizeof(line), fmt, args );
+	va_end( args );
+	if ( len > 0 ) page.append( line, std::min( (size_t)len, sizeof(line) - 1 ) );
+}
 
-                        if( led_enabled_[led_idx] && leds_ )
-                        {
-                            if( queue_length > 0 )
-                            {
-                                leds_->Set( LED_BLUE, led_idx, true );
-                                leds_->Set( LED_RED, led_idx, true );
-                            }
-                            else
-                            {
-                                leds_->Set( LED_BLUE, led_idx, true );
-                                leds_->Set( LED_RED, led_idx, false );
-                            }
-                        }
-                    }
-                }
-                if( debug )
-                    std::cout << "\n";
+/////////////////////////////////////////////////////////////////////////////
+/// render what the last sample found into the metrics page
+void DeviceMonitor::renderMetrics_( ) {
+	std::string& page = metrics_->Page( );
+	const size_t num_disks = disk_fd_.size();
+	
+	// per bay counters straight from the stat files
+	static const struct {
+		const char*		name;
+		const char*		type;
+		const char*		help;
+		size_t			field;
+		unsigned int	scale;		///< multiply by (sectors to bytes)
+		unsigned int	divide;		///< divide by (ms to seconds)
+	} COUNTERS[] = {
+		{ "reads_completed_total",	"counter",	"Read I/Os completed",					DiskStats::READS_COMPLETED,		1,		1		},
+		{ "writes_completed_total",	"counter",	"Write I/Os completed",					DiskStats::WRITES_COMPLETED,	1,		1		},
+		{ "read_bytes_total",		"counter",	"Bytes read",							DiskStats::SECTORS_READ,		512,	1		},
+		{ "written_bytes_total",	"counter",	"Bytes written",						DiskStats::SECTORS_WRITTEN,		512,	1		},
+		{ "io_time_seconds_total",	"counter",	"Time spent doing I/O",					DiskStats::IO_TICKS,			1,		1000	},
+		{ "in_flight",				"gauge",	"I/Os in flight at the last sample",	DiskStats::IN_FLIGHT,			1,		1		},
+	};
+	
+	metric( page, "# HELP mediasmartserverd_bay_info Disk in each bay\n# TYPE mediasmartserverd_bay_info gauge\n" );
+	for ( size_t i = 0; i < num_disks; ++i ) {
+		const char* device = strrchr( disk_syspath_[i].c_str(), '/' );
+		metric( page, "mediasmartserverd_bay_info{bay=\"%d\",device=\"%s\"} 1\n", disk_led_[i], ( device ) ? device + 1 : "" );
+	}
+	
+	for ( size_t c = 0; c < sizeof(COUNTERS) / sizeof(COUNTERS[0]); ++c ) {
+		metric( page, "# HELP mediasmartserverd_bay_%s %s\n# TYPE mediasmartserverd_bay_%s %s\n",
+			COUNTERS[c].name, COUNTERS[c].help, COUNTERS[c].name, COUNTERS[c].type );
+		for ( size_t i = 0; i < num_disks; ++i ) {
+			const unsigned long long val = disk_stats_[i].field[ COUNTERS[c].field ] * COUNTERS[c].scale;
+			if ( 1 == COUNTERS[c].divide ) {
+				metric( page, "mediasmartserverd_bay_%s{bay=\"%d\"} %llu\n", COUNTERS[c].name, disk_led_[i], val );
+			} else {
+				metric( page, "mediasmartserverd_bay_%s{bay=\"%d\"} %.3f\n", COUNTERS[c].name, disk_led_[i], (double)val / COUNTERS[c].divide );
+			}
+		}
+	}
+	
+	metric( page, "# HELP mediasmartserverd_bay_utilisation_ratio Share of the last sample interval spent doing I/O\n"
+		"# TYPE mediasmartserverd_bay_utilisation_ratio gauge\n" );
+	for ( size_t i = 0; i < num_disks; ++i ) {
+		metric( page, "mediasmartserverd_bay_utilisation_ratio{bay=\"%d\"} %.3f\n", disk_led_[i], disk_util_[i] );
+	}
+	
+	// LEDs as last written
+	const LedFrame leds = compositor_->Output( );
+	metric( page, "# HELP mediasmartserverd_bay_led Bay LED colours lit (2 when blinking)\n# TYPE mediasmartserverd_bay_led gauge\n" );
+	for ( size_t i = 0; i < LedFrame::MAX_BAYS; ++i ) {
+		if ( !leds.bay[i] && !leds.bay_blink[i] && disk_led_.end() == std::find( disk_led_.begin(), disk_led_.end(), (int)i ) ) continue;
+		metric( page, "mediasmartserverd_bay_led{bay=\"%lu\",colour=\"blue\"} %d\n", (unsigned long)i,
+			( leds.bay_blink[i] & LED_BLUE ) ? 2 : !!( leds.bay[i] & LED_BLUE ) );
+		metric( page, "mediasmartserverd_bay_led{bay=\"%lu\",colour=\"red\"} %d\n", (unsigned long)i,
+			( leds.bay_blink[i] & LED_RED ) ? 2 : !!( leds.bay[i] & LED_RED ) );
 	}
+	metric( page, "# HELP mediasmartserverd_system_led System LED colours lit (2 when blinking)\n# TYPE mediasmartserverd_system_led gauge\n" );
+	metric( page, "mediasmartserverd_system_led{colour=\"blue\"} %d\n", ( leds.system_blink & LED_BLUE ) ? 2 : !!( leds.system_on & LED_BLUE ) );
+	metric( page, "mediasmartserverd_system_led{colour=\"red\"} %d\n",  ( leds.system_blink & LED_RED  ) ? 2 : !!( leds.system_on & LED_RED  ) );
+	
+	metrics_->Publish( );
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -218,13 +401,82 @@ void DeviceMonitor::deviceRemove_( udev_device* device ) {
 void DeviceMonitor::deviceChanged_( udev_device* device, bool state ) {
 	if (!acceptDevice_(device)) return;
 
-	int led_idx = scsiHostIndex_(device);
+	int led_idx = scsiHostIndex_( udev_device_get_syspath(device) );
 	if (led_idx < 0) return;
 	if (debug) std::cout << " device: " << udev_device_get_syspath(device) << "\n led: " << led_idx << "\n";
 
+	// keep the activity table up to date
+	if ( state ) {
+		addDisk_( device, led_idx );
+	} else {
+		removeDisk_( device );
+	}
+
 	// finally we can play with the appopriate LED
-	if ( leds_ ) leds_->Set( LED_BLUE, led_idx, state );
-        led_enabled_[led_idx] = state;
+	presence_.SetBay( led_idx, ( state ) ? LED_BLUE : 0 );
+	if ( !state ) {
+		activity_.bays &= ~( 1U << led_idx );
+		pwm_.SetDuty( led_idx, 0 );
+		pwm_.Sync( );
+	}
+	if ( compositor_ ) compositor_->Publish( LAYER_PRESENCE, presence_ );
+	publishActivity_( );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// add a disk to the registry
+void DeviceMonitor::addDisk_( udev_device* device, int led_idx ) {
+	const char* syspath = udev_device_get_syspath(device);
+	if ( disk_syspath_.end() != std::find( disk_syspath_.begin(), disk_syspath_.end(), syspath ) ) return;
+	
+	// make sure it's there and keep it open for sampling
+	std::string stats_file( syspath );
+	stats_file.append( "/stat" );
+	const int fd = DiskStats::Open( stats_file.c_str() );
+	if ( fd < 0 ) {
+		std::cout << " Couldn't open stats " << stats_file << "\n";
+		return;
+	}
+	
+	// baseline sample for activity deltas
+	DiskStats stats;
+	if ( !stats.Read( fd ) ) stats = DiskStats();
+	
+	disk_syspath_.push_back( syspath );
+	disk_fd_.push_back( fd );
+	disk_led_.push_back( led_idx );
+	disk_stats_.push_back( stats );
+	disk_util_.push_back( 0.0f );
+	disk_read_led_.push_back( ActivityLed() );
+	disk_write_led_.push_back( ActivityLed() );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// remove a disk from the registry
+void DeviceMonitor::removeDisk_( udev_device* device ) {
+	const std::vector< std::string >::iterator it = std::find( disk_syspath_.begin(), disk_syspath_.end(), udev_device_get_syspath(device) );
+	if ( disk_syspath_.end() == it ) return;
+	const size_t i = it - disk_syspath_.begin();
+	const size_t last = disk_syspath_.size() - 1;
+	
+	close( disk_fd_[i] );
+	
+	// move the last disk into the gap
+	disk_syspath_[i].swap( disk_syspath_[last] );
+	disk_fd_[i]			= disk_fd_[last];
+	disk_led_[i]		= disk_led_[last];
+	disk_stats_[i]		= disk_stats_[last];
+	disk_util_[i]		= disk_util_[last];
+	disk_read_led_[i]	= disk_read_led_[last];
+	disk_write_led_[i]	= disk_write_led_[last];
+	
+	disk_syspath_.pop_back();
+	disk_fd_.pop_back();
+	disk_led_.pop_back();
+	disk_stats_.pop_back();
+	disk_util_.pop_back();
+	disk_read_led_.pop_back();
+	disk_write_led_.pop_back();
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -250,82 +502,94 @@ void DeviceMonitor::enumDevices_( ) {
 				udev_list_entry_get_name( list_entry )
 			), &udev_device_unref
 		);
-                if ( !device ) continue;
-
+		if ( !device ) continue;
+		
 		if (!acceptDevice_(device.get())) continue;
-
-		int led_idx = scsiHostIndex_(device.get());
-		if (led_idx < 0) continue;
-		if (debug || verbose > 1) std::cout << " device: " << udev_device_get_syspath(device.get()) << "\n led: " << led_idx << "\n";
-
-		leds_idx_[num_disks_] = led_idx;
-
-                stats_files_[num_disks_] = std::string( udev_device_get_syspath(device.get()) );
-                stats_files_[num_disks_].append( "/stat" );
-
-                // make sure it's there and we can open it
-                std::ifstream stats;
-                stats.open( stats_files_[num_disks_].c_str() );
-                if( !stats )
-                {
-                    std::cout << " Couldn't open stats " << stats_files_[num_disks_] << "\n";
-                    continue;
-                }
-                else
-                    stats.close();
-
-                ++num_disks_;
-
+		if (debug || verbose > 1) std::cout << " device: " << udev_device_get_syspath(device.get()) << "\n";
+		
 		deviceAdded_( device.get() );
 	}
 }
 
 /////////////////////////////////////////////////////////////////////////////
-/// calculate disk indices using scsi_host unique_id
-int DeviceMonitor::scsiHostIndex_( udev_device* device ) {
-	udev* udev = udev_device_get_udev(device);
-	std::string device_sys_path (udev_device_get_syspath(device));
-	std::string bus_prefix ("");
-
-	bool use_ata = false;
-	int host_index = 0;
-	int bus_index_correction = 0;
-
-	size_t index_of = device_sys_path.find("/ata");
-	if (index_of != std::string::npos) {
-		bus_prefix.append(device_sys_path.substr(0, index_of + 4));
-		host_index = device_sys_path.at(index_of + 10) - '0';
-		bus_index_correction = device_sys_path.at(index_of + 4) - '0' - host_index;
-		use_ata = true;
-	} else {
-		index_of = device_sys_path.find("/host");
-		bus_prefix.append(device_sys_path.substr(0, index_of));
-		host_index = device_sys_path.at(index_of) - '0';
+/// find the ".../ataN/hostM" part of a sysfs path
+/// @param path sysfs path
+/// @param prefix_len Optionally receives the length of the controller prefix (up to and including "/ata")
+/// @return scsi host number M, or -1 if the path isn't below an ata port
+static int ata_host_number( const char* path, size_t* prefix_len ) {
+	for ( const char* p = strstr( path, "/ata" ); p; p = strstr( p + 1, "/ata" ) ) {
+		const char* q = p + 4;
+		if ( *q < '0' || *q > '9' ) continue;
+		while ( *q >= '0' && *q <= '9' ) ++q;
+		if ( 0 != strncmp( q, "/host", 5 ) ) continue;
+		q += 5;
+		if ( *q < '0' || *q > '9' ) continue;
+		
+		int host = 0;
+		for ( ; *q >= '0' && *q <= '9'; ++q ) host = host * 10 + ( *q - '0' );
+		if ( prefix_len ) *prefix_len = p + 4 - path;
+		return host;
 	}
+	return -1;
+}
 
-	int scsi_host_index = -1;
-	for (int i = 0; i <= host_index; i++) {
-		std::string dev_path (bus_prefix);
-
-		if (use_ata) {
-			dev_path.append(1, '0' + bus_index_correction + i);
-		}
-
-		dev_path.append("/host");
-		dev_path.append(1, '0' + i);
-
-		udev_device* dev_host = udev_device_new_from_syspath(udev, dev_path.c_str());
-		if (dev_host) {
-			scsi_host_index++;
+/////////////////////////////////////////////////////////////////////////////
+/// work out bay indices from the scsi hosts present
+///
+/// Bays are numbered by the position of their scsi host among all hosts on
+/// the same ata controller. This only changes when scsi hosts come or go,
+/// so it's worked out once here and refreshed on scsi_host events.
+void DeviceMonitor::scanScsiHosts_( ) {
+	assert( dev_context_ );
+	
+	std::tr1::shared_ptr< udev_enumerate > dev_enum( udev_enumerate_new( dev_context_ ), &udev_enumerate_unref );
+	udev_enumerate_add_match_subsystem( dev_enum.get(), "scsi_host" );
+	udev_enumerate_scan_devices( dev_enum.get() );
+	
+	// group hosts by controller
+	typedef std::map< std::string, std::vector< int > > ControllerMap;
+	ControllerMap controllers;
+	int max_host = -1;
+	
+	udev_list_entry* list_entry = udev_enumerate_get_list_entry( dev_enum.get() );
+	for ( ; list_entry; list_entry = udev_list_entry_get_next( list_entry ) ) {
+		const char* path = udev_list_entry_get_name( list_entry );
+		size_t prefix_len = 0;
+		const int host = ata_host_number( path, &prefix_len );
+		if ( host < 0 ) continue;
+		
+		std::vector< int >& hosts = controllers[ std::string( path, prefix_len ) ];
+		if ( hosts.end() == std::find( hosts.begin(), hosts.end(), host ) ) hosts.push_back( host );
+		max_host = std::max( max_host, host );
+	}
+	
+	// bay index is the host's position on its controller
+	bay_by_host_.assign( max_host + 1, -1 );
+	for ( ControllerMap::iterator it = controllers.begin(); it != controllers.end(); ++it ) {
+		std::vector< int >& hosts = it->second;
+		std::sort( hosts.begin(), hosts.end() );
+		for ( size_t i = 0; i < hosts.size(); ++i ) {
+			bay_by_host_[ hosts[i] ] = i;
+			if ( debug ) std::cout << " host" << hosts[i] << " -> bay " << i << " (" << it->first << ")\n";
 		}
 	}
+}
 
-	return scsi_host_index;
+/////////////////////////////////////////////////////////////////////////////
+/// look up the bay index for a disk from its scsi host
+/// @param syspath sysfs path of the disk
+int DeviceMonitor::scsiHostIndex_( const char* syspath ) const {
+	const int host = ata_host_number( syspath, 0 );
+	if ( host < 0 || host >= (int)bay_by_host_.size() ) return -1;
+	return bay_by_host_[ host ];
 }
 
 /////////////////////////////////////////////////////////////////////////////
 /// test if the given device is acceptable
 bool DeviceMonitor::acceptDevice_( udev_device* device ) {
-	return strcmp("ata", udev_device_get_property_value(device, "ID_BUS")) == 0
-		&& strcmp("disk", udev_device_get_property_value(device, "DEVTYPE")) == 0;
+	const char* bus     = udev_device_get_property_value(device, "ID_BUS");
+	const char* devtype = udev_device_get_property_value(device, "DEVTYPE");
+	return bus && devtype
+		&& strcmp("ata", bus) == 0
+		&& strcmp("disk", devtype) == 0;
 }
@@ -31,10 +31,17 @@
 #define INCLUDED_DEVICE_MONITOR
 
 //- includes
-#include "led_control_base.h"
+#include "activity_led.h"
+#include "disk_stats.h"
+#include "event_loop.h"
+#include "led_compositor.h"
+#include "metrics_server.h"
+#include "pwm_scheduler.h"
+#include "tick_timer.h"
 
 #include <string>
 #include <map>
+#include <vector>
 
 //- forwards
 struct udev;
@@ -43,35 +50,70 @@ struct udev_monitor;
 
 /////////////////////////////////////////////////////////////////////////////
 /// device monitor
-class DeviceMonitor {
+class DeviceMonitor : public EventHandler {
 public:
 	DeviceMonitor( );
 	~DeviceMonitor( );
 	
-	void Init( const LedControlPtr& leds );
-	void Main( );
+	void Init( const LedCompositorPtr& compositor );
+	
+	/// publish disk stats and LED state to a metrics page every sample
+	/// (samples even without activity lights), before Attach
+	void SetMetrics( MetricsServer* metrics ) { metrics_ = metrics; }
+	
+	/// start handling udev, activity sampling and LED timing events from the loop
+	void Attach( EventLoop& loop );
+	
+	/// print activity sampling stats
+	void Report( ) const;
+	
+	virtual void OnEvent( int fd, unsigned int events );
+	virtual void BeforeWait( );
 
-        int numDisks()  {  return num_disks_;  }
-        std::string &statsFile( int disk_idx )  {  return stats_files_[disk_idx];  }
-        int ledIndex( int disk_idx )  {  return leds_idx_[disk_idx];  }
+	int numDisks( ) const { return disk_fd_.size(); }
+	int ledIndex( int disk_idx ) const { return disk_led_[disk_idx]; }
 	
 protected:
+	void deviceEvent_( );
 	void deviceAdded_( udev_device* device );
 	void deviceRemove_( udev_device* device );
 	void deviceChanged_( udev_device* device, bool state );
 	void enumDevices_();
-	int scsiHostIndex_( udev_device* device );
+	void addDisk_( udev_device* device, int led_idx );
+	void removeDisk_( udev_device* device );
+	int sampleActivity_( int interval );
+	void publishActivity_( );
+	void renderMetrics_( );
+	int scsiHostIndex_( const char* syspath ) const;
+	void scanScsiHosts_( );
 	bool acceptDevice_( udev_device* device );
 	
 	udev*			dev_context_;	///< udev library context
 	udev_monitor*	dev_monitor_;	///< udev monitor context
 	
-	LedControlPtr	leds_;			///< led control interface
+	LedCompositorPtr	compositor_;	///< where our LED intents go
+	LedFrame			presence_;		///< bays with disks (LAYER_PRESENCE)
+	LedFrame			activity_;		///< disk activity (LAYER_ACTIVITY)
+	PwmScheduler		pwm_;			///< per bay intensity (--intensity)
+	TickTimer			ticker_;		///< activity sampling
+	TickTimer			blinker_;		///< software blinking (only runs while needed)
+	unsigned long long	last_sample_ms_;	///< when activity was last sampled
+	int					interval_;		///< current sampling interval (backs off while all bays are idle)
+	MetricsServer*		metrics_;		///< where to publish stats (if anywhere)
+	bool				sampled_;		///< sampled since the metrics were last rendered?
+	unsigned long long	woken_us_;		///< when the first event since the last commit woke us (0 if none)
+	unsigned long long	generation_;	///< compositor generation at the last commit
 
-        int num_disks_;
-        std::string stats_files_[10];  // each disk's stat file
-        bool led_enabled_[10];  // does a particular led have a disk in the bay?
-        int leds_idx_[10];      // maps disk index to led index
+	std::vector< int >	bay_by_host_;	///< bay index by scsi host number (-1 if none)
+	
+	//- disk registry, one column per field so the sampling loop walks dense memory
+	std::vector< std::string >	disk_syspath_;		///< sysfs path (to find the disk on removal)
+	std::vector< int >			disk_fd_;			///< stat file, kept open for sampling
+	std::vector< int >			disk_led_;			///< bay LED index
+	std::vector< DiskStats >	disk_stats_;		///< previous sample
+	std::vector< float >		disk_util_;			///< share of the last interval spent doing I/O
+	std::vector< ActivityLed >	disk_read_led_;		///< pulse stretching for read activity (blue)
+	std::vector< ActivityLed >	disk_write_led_;	///< pulse stretching for write activity (red)
 };
 
 #endif // INCLUDED_DEVICE_MONITOR
@@ -0,0 +1,102 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file disk_stats.cpp
+///
+/// Allocation free sampling of block device statistics (/sys/block/*/stat)
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+//- includes
+#include "disk_stats.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+/////////////////////////////////////////////////////////////////////////////
+/// open a stat file for repeated sampling
+int DiskStats::Open( const char* path ) {
+	return open( path, O_RDONLY | O_CLOEXEC );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// re-read an already opened stat file
+///
+/// sysfs regenerates the attribute whenever it is read from offset 0, so a
+/// single pread gives us a fresh sample without reopening the file.
+bool DiskStats::Read( int fd ) {
+	char buf[256];
+	const ssize_t len = pread( fd, buf, sizeof(buf), 0 );
+	if ( len <= 0 ) return false;
+	
+	return Parse( buf, len );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// parse the contents of a stat file
+bool DiskStats::Parse( const char* buf, size_t len ) {
+	const char* p   = buf;
+	const char* end = buf + len;
+	
+	count = 0;
+	while ( count < MAX_FIELDS ) {
+		// skip whitespace
+		while ( p != end && ( ' ' == *p || '\t' == *p ) ) ++p;
+		if ( p == end || '0' > *p || '9' < *p ) break;
+		
+		// scan digits
+		unsigned long long val = 0;
+		for ( ; p != end && '0' <= *p && '9' >= *p; ++p ) {
+			val = val * 10 + ( *p - '0' );
+		}
+		field[ count++ ] = val;
+	}
+	
+	// zero anything an older kernel didn't give us
+	for ( size_t i = count; i < MAX_FIELDS; ++i ) field[i] = 0;
+	
+	return count > TIME_IN_QUEUE;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// difference between two samples of a counter
+///
+/// Counters are held as 64 bit but a 32 bit kernel reports most of them as
+/// an unsigned long, so they wrap at 2^32. A counter going backwards past
+/// anything a 32 bit counter could hold means it was reset (device replaced).
+unsigned long long DiskStats::Delta( unsigned long long prev, unsigned long long cur ) {
+	if ( cur >= prev ) return cur - prev;
+	if ( prev <= 0xFFFFFFFFULL ) return cur + ( 0x100000000ULL - prev );
+	return cur;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// work out what happened between two samples
+void DiskActivity::Update( const DiskStats& prev, const DiskStats& cur ) {
+	reads			= DiskStats::Delta( prev.field[DiskStats::READS_COMPLETED],  cur.field[DiskStats::READS_COMPLETED]  );
+	writes			= DiskStats::Delta( prev.field[DiskStats::WRITES_COMPLETED], cur.field[DiskStats::WRITES_COMPLETED] );
+	sectors_read	= DiskStats::Delta( prev.field[DiskStats::SECTORS_READ],     cur.field[DiskStats::SECTORS_READ]     );
+	sectors_written	= DiskStats::Delta( prev.field[DiskStats::SECTORS_WRITTEN],  cur.field[DiskStats::SECTORS_WRITTEN]  );
+	io_ticks		= DiskStats::Delta( prev.field[DiskStats::IO_TICKS],         cur.field[DiskStats::IO_TICKS]         );
+	in_flight		= cur.field[DiskStats::IN_FLIGHT];
+}
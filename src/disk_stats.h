@@ -0,0 +1,107 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file disk_stats.h
+///
+/// Allocation free sampling of block device statistics (/sys/block/*/stat)
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_DISK_STATS
+#define INCLUDED_DISK_STATS
+
+//- includes
+#include <stddef.h>
+
+/////////////////////////////////////////////////////////////////////////////
+/// one sample of a block device's stat file
+///
+/// The kernel reports 11 fields, 15 since 4.18 (discards) and 17 since 5.5
+/// (flushes). Fields the kernel didn't report are left at zero.
+struct DiskStats {
+	/// field order as documented in Documentation/block/stat
+	enum {
+		READS_COMPLETED		= 0,	///< read I/Os processed
+		READS_MERGED,				///< read I/Os merged with in-queue I/O
+		SECTORS_READ,				///< sectors read
+		READ_TICKS,					///< total wait time for read requests (ms)
+		WRITES_COMPLETED,			///< write I/Os processed
+		WRITES_MERGED,				///< write I/Os merged with in-queue I/O
+		SECTORS_WRITTEN,			///< sectors written
+		WRITE_TICKS,				///< total wait time for write requests (ms)
+		IN_FLIGHT,					///< number of I/Os currently in flight
+		IO_TICKS,					///< total time this block device has been active (ms)
+		TIME_IN_QUEUE,				///< total wait time for all requests (ms)
+		DISCARDS_COMPLETED,			///< discard I/Os processed
+		DISCARDS_MERGED,			///< discard I/Os merged with in-queue I/O
+		SECTORS_DISCARDED,			///< sectors discarded
+		DISCARD_TICKS,				///< total wait time for discard requests (ms)
+		FLUSHES_COMPLETED,			///< flush I/Os processed
+		FLUSH_TICKS,				///< total wait time for flush requests (ms)
+		
+		MAX_FIELDS
+	};
+	
+	unsigned long long	field[ MAX_FIELDS ];	///< counter values
+	size_t				count;					///< number of fields reported
+	
+	/// open a stat file for repeated sampling (returns -1 on failure)
+	static int Open( const char* path );
+	
+	/// re-read an already opened stat file
+	bool Read( int fd );
+	
+	/// parse the contents of a stat file
+	bool Parse( const char* buf, size_t len );
+	
+	/// difference between two samples of a counter
+	static unsigned long long Delta( unsigned long long prev, unsigned long long cur );
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// disk activity between two consecutive samples
+///
+/// Deciding on counter deltas rather than the instantaneous in-flight count
+/// means I/O that starts and completes between two samples is never missed.
+struct DiskActivity {
+	unsigned long long	reads;				///< read I/Os completed
+	unsigned long long	writes;				///< write I/Os completed
+	unsigned long long	sectors_read;		///< sectors read
+	unsigned long long	sectors_written;	///< sectors written
+	unsigned long long	io_ticks;			///< time spent doing I/O (ms)
+	unsigned long long	in_flight;			///< I/Os in flight at the time of the sample
+	
+	/// work out what happened between two samples
+	void Update( const DiskStats& prev, const DiskStats& cur );
+	
+	/// any read activity?
+	bool Reading( ) const { return reads || sectors_read; }
+	
+	/// any write activity?
+	bool Writing( ) const { return writes || sectors_written; }
+	
+	/// any activity at all (including I/O that hasn't completed yet)?
+	bool Busy( ) const { return Reading( ) || Writing( ) || io_ticks || in_flight; }
+};
+
+#endif // INCLUDED_DISK_STATS
@@ -0,0 +1,243 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file event_loop.cpp
+///
+/// Single threaded epoll event loop
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+//- includes
+#include "event_loop.h"
+#include "errno_exception.h"
+#include "loop_profile.h"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+
+//- constants
+static const int MAX_EVENTS = 16;	///< events taken per wait
+
+/////////////////////////////////////////////////////////////////////////////
+/// what epoll hands back with an event: the fd and which registration of it
+///
+/// A handler can remove an fd that has an event later in the same batch, and
+/// the number can be reused by a new source straight away, so the fd alone
+/// isn't enough to tell whose event it is.
+static epoll_data_t event_tag( int fd, unsigned int generation ) {
+	epoll_data_t data;
+	data.u64 = ( (unsigned long long)generation << 32 ) | (unsigned int)fd;
+	return data;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// monotonic clock in microseconds
+static unsigned long long monotonic_us( ) {
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// constructor
+EventLoop::Stats::Stats( )
+	:	events( 0 )
+	,	max_us( 0 )
+{
+	std::fill( histogram, histogram + BUCKETS, 0 );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// constructor
+EventLoop::EventLoop( )
+	:	epoll_fd_( -1 )
+	,	signal_fd_( -1 )
+	,	quit_( false )
+	,	generation_( 0 )
+{
+	epoll_fd_ = epoll_create1( EPOLL_CLOEXEC );
+	if ( -1 == epoll_fd_ ) throw ErrnoException( "epoll_create1" );
+	
+	// signals we stop for (or dump/reset the profile on) are read from a
+	// signalfd rather than interrupting us
+	sigset_t mask;
+	sigemptyset( &mask );
+	sigaddset( &mask, SIGINT );
+	sigaddset( &mask, SIGTERM );
+	sigaddset( &mask, SIGUSR1 );
+	sigaddset( &mask, SIGUSR2 );
+	if ( -1 == sigprocmask( SIG_BLOCK, &mask, &old_mask_ ) ) throw ErrnoException( "sigprocmask" );
+	
+	signal_fd_ = signalfd( -1, &mask, SFD_NONBLOCK | SFD_CLOEXEC );
+	if ( -1 == signal_fd_ ) throw ErrnoException( "signalfd" );
+	
+	epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data = event_tag( signal_fd_, 0 );
+	if ( -1 == epoll_ctl( epoll_fd_, EPOLL_CTL_ADD, signal_fd_, &ev ) ) throw ErrnoException( "epoll_ctl(signalfd)" );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// destructor
+EventLoop::~EventLoop( ) {
+	if ( -1 != signal_fd_ ) close( signal_fd_ );
+	if ( -1 != epoll_fd_ ) close( epoll_fd_ );
+	sigprocmask( SIG_SETMASK, &old_mask_, 0 );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// start telling a handler when fd is readable
+void EventLoop::Add( int fd, EventHandler* handler, const char* name ) {
+	if ( !++generation_ ) ++generation_;
+	
+	epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data = event_tag( fd, generation_ );
+	if ( -1 == epoll_ctl( epoll_fd_, EPOLL_CTL_ADD, fd, &ev ) ) throw ErrnoException( "epoll_ctl(add)" );
+	
+	Source source = { handler, &stats_[name], generation_ };
+	sources_[fd] = source;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// change what fd is watched for
+void EventLoop::Modify( int fd, unsigned int events ) {
+	std::map< int, Source >::const_iterator it = sources_.find( fd );
+	if ( sources_.end() == it ) return;
+	
+	epoll_event ev;
+	ev.events = events;
+	ev.data = event_tag( fd, it->second.generation );
+	if ( -1 == epoll_ctl( epoll_fd_, EPOLL_CTL_MOD, fd, &ev ) ) throw ErrnoException( "epoll_ctl(mod)" );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// stop watching fd
+void EventLoop::Remove( int fd ) {
+	if ( !sources_.erase( fd ) ) return;
+	epoll_ctl( epoll_fd_, EPOLL_CTL_DEL, fd, 0 );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// call handler->BeforeWait() before each wait
+void EventLoop::AddBeforeWait( EventHandler* handler ) {
+	before_wait_.push_back( handler );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// handle events until signalled or Quit()
+void EventLoop::Run( ) {
+	quit_ = false;
+	
+	epoll_event events[MAX_EVENTS];
+	while ( !quit_ ) {
+		for ( size_t i = 0; i < before_wait_.size(); ++i ) before_wait_[i]->BeforeWait( );
+		
+		const int cnt = epoll_wait( epoll_fd_, events, MAX_EVENTS, -1 );
+		if ( cnt < 0 ) {
+			if ( EINTR == errno ) continue;
+			throw ErrnoException( "epoll_wait" );
+		}
+		
+		const unsigned long long woken_us = monotonic_us( );
+		for ( int i = 0; i < cnt; ++i ) {
+			const int fd = (int)( events[i].data.u64 & 0xFFFFFFFFU );
+			const unsigned int generation = (unsigned int)( events[i].data.u64 >> 32 );
+			if ( 0 == generation && fd == signal_fd_ ) {
+				if ( signalled_( ) ) quit_ = true;
+				continue;
+			}
+			
+			// an earlier handler this round may have removed it, and maybe
+			// registered something else under the same number since
+			std::map< int, Source >::iterator it = sources_.find( fd );
+			if ( sources_.end() == it || it->second.generation != generation ) continue;
+			
+			Stats& stats = *it->second.stats;
+			it->second.handler->OnEvent( fd, events[i].events );
+			
+			// from waking up to handled, so waiting behind other handlers counts
+			const unsigned long long latency_us = monotonic_us( ) - woken_us;
+			++stats.events;
+			stats.max_us = std::max( stats.max_us, latency_us );
+			++stats.histogram[ ( latency_us ) ? std::min( 64 - __builtin_clzll( latency_us ), BUCKETS - 1 ) : 0 ];
+		}
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// print event handling latency per source
+void EventLoop::Report( ) const {
+	const std::ios::fmtflags flags = std::cout.flags( );
+	const std::streamsize precision = std::cout.precision( );
+	
+	for ( std::map< std::string, Stats >::const_iterator it = stats_.begin(); it != stats_.end(); ++it ) {
+		const Stats& stats = it->second;
+		if ( !stats.events ) continue;
+		
+		std::cout << it->first << " event latency over " << stats.events << " events (max " << stats.max_us << "us):\n";
+		for ( size_t i = 0; i < BUCKETS; ++i ) {
+			if ( !stats.histogram[i] ) continue;
+			
+			const unsigned long long lo = ( i ) ? 1ULL << ( i - 1 ) : 0;
+			const unsigned long long hi = ( i ) ? ( 1ULL << i ) - 1 : 0;
+			std::cout << "  " << std::setw( 10 ) << lo << " - " << std::setw( 10 ) << hi << "us: "
+				<< stats.histogram[i] << " (" << std::fixed << std::setprecision( 2 ) << 100.0 * stats.histogram[i] / stats.events << "%)\n";
+		}
+	}
+	
+	std::cout.flags( flags );
+	std::cout.precision( precision );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// read pending signals
+/// @return whether one means we should stop
+bool EventLoop::signalled_( ) {
+	bool stop = false;
+	signalfd_siginfo info;
+	while ( sizeof(info) == read( signal_fd_, &info, sizeof(info) ) ) {
+		switch ( info.ssi_signo ) {
+		case SIGINT:
+		case SIGTERM:
+			stop = true;
+			break;
+		case SIGUSR1: // what's been going on?
+			loop_profile.Dump( );
+			Report( );
+			break;
+		case SIGUSR2: // start counting afresh
+			loop_profile.Reset( );
+			for ( std::map< std::string, Stats >::iterator it = stats_.begin(); it != stats_.end(); ++it ) it->second = Stats( );
+			break;
+		}
+	}
+	
+	if ( stop ) std::cout << "Exiting on signal\n";
+	return stop;
+}
@@ -0,0 +1,126 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file event_loop.h
+///
+/// Single threaded epoll event loop
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_EVENT_LOOP
+#define INCLUDED_EVENT_LOOP
+
+//- includes
+#include <map>
+#include <string>
+#include <vector>
+#include <signal.h>
+
+/////////////////////////////////////////////////////////////////////////////
+/// something that wants to hear about file descriptors becoming ready
+class EventHandler {
+public:
+	virtual ~EventHandler( ) { }
+	
+	/// a file descriptor registered with EventLoop::Add is ready
+	/// @param events EPOLLIN etc
+	virtual void OnEvent( int fd, unsigned int events ) = 0;
+	
+	/// called before each wait once a round of events is handled
+	/// (see EventLoop::AddBeforeWait)
+	virtual void BeforeWait( ) { }
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// single threaded event loop
+///
+/// Every source of work (udev, timers, sockets, inotify, helper processes)
+/// is a file descriptor registered here, and SIGINT/SIGTERM arrive through
+/// a signalfd, so everything runs on the one thread and nothing needs
+/// cancelling to shut down. The time from waking up to each handler
+/// finishing is recorded per source. SIGUSR1 prints that and the
+/// LoopProfile counters, SIGUSR2 resets them.
+class EventLoop {
+public:
+	EventLoop( );
+	~EventLoop( );
+	
+	/// start telling a handler when fd is readable
+	/// @param name Source name for Report() (sources with the same name share stats)
+	void Add( int fd, EventHandler* handler, const char* name );
+	
+	/// change what fd is watched for (EPOLLIN, EPOLLOUT)
+	void Modify( int fd, unsigned int events );
+	
+	/// stop watching fd (before closing it)
+	void Remove( int fd );
+	
+	/// call handler->BeforeWait() before each wait, in the order added
+	void AddBeforeWait( EventHandler* handler );
+	
+	/// handle events until signalled or Quit()
+	void Run( );
+	
+	/// make Run() return after the current round of events
+	void Quit( ) { quit_ = true; }
+	
+	/// print event handling latency per source
+	void Report( ) const;
+	
+private:
+	enum {
+		BUCKETS	= 33,	///< log2 latency buckets (0us, 1us, 2-3us, 4-7us, ...)
+	};
+	
+	/// latency of handling events from one kind of source
+	struct Stats {
+		Stats( );
+		unsigned long long	events;				///< events handled
+		unsigned long long	max_us;				///< worst latency
+		unsigned long long	histogram[BUCKETS];	///< latency (log2 buckets)
+	};
+	
+	/// a registered file descriptor
+	struct Source {
+		EventHandler*		handler;			///< who to tell
+		Stats*				stats;				///< where its latency goes
+		unsigned int		generation;			///< which registration of the fd this is
+	};
+	
+	bool signalled_( );
+	
+	int								epoll_fd_;		///< epoll instance
+	int								signal_fd_;		///< SIGINT, SIGTERM, SIGUSR1 and SIGUSR2
+	sigset_t						old_mask_;		///< signal mask to restore
+	bool							quit_;			///< finish up?
+	unsigned int					generation_;	///< last registration handed out (0 is the signalfd's)
+	std::map< int, Source >			sources_;		///< by file descriptor
+	std::map< std::string, Stats >	stats_;			///< by source name
+	std::vector< EventHandler* >	before_wait_;	///< BeforeWait() hooks
+	
+	// no copying
+	EventLoop( const EventLoop& rhs );
+	const EventLoop& operator=( const EventLoop& rhs );
+};
+
+#endif // INCLUDED_EVENT_LOOP
@@ -0,0 +1,239 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file helper_process.cpp
+///
+/// Time and memory bounded helper processes with non-blocking output
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+//- includes
+#include "helper_process.h"
+#include "realtime.h"
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <vector>
+
+#ifndef __NR_pidfd_open
+#define __NR_pidfd_open 434
+#endif
+
+extern char** environ;
+
+//- constants
+static const size_t MAX_OUTPUT = 64 * 1024;	///< output kept (the rest is drained and dropped)
+static const int FALLBACK_POLL_MS = 50;		///< how often to look for exit without a pidfd
+
+/////////////////////////////////////////////////////////////////////////////
+/// monotonic clock in milliseconds
+static unsigned long long monotonic_ms( ) {
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return now.tv_sec * 1000ULL + now.tv_nsec / 1000000;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// constructor
+HelperProcess::HelperProcess( )
+	:	pid_( 0 )
+	,	out_fd_( -1 )
+	,	pid_fd_( -1 )
+	,	deadline_ms_( 0 )
+	,	status_( 0 )
+	,	timed_out_( false )
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// destructor
+HelperProcess::~HelperProcess( ) {
+	Kill( );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// start a helper
+bool HelperProcess::Start( const char* const argv[], int timeout_ms, size_t mem_limit ) {
+	Kill( );
+	output_.clear( );
+	status_ = 0;
+	timed_out_ = false;
+	
+	// a limit set after posix_spawn would leave a window, and one set in our
+	// own process would hit our other threads, so a shell sets it and execs
+	std::vector< const char* > args( argv, argv + 1 );
+	char script[64];
+	if ( mem_limit ) {
+		// the shell would only fail later, and less clearly
+		if ( -1 == access( argv[0], X_OK ) ) return false;
+		
+		snprintf( script, sizeof(script), "ulimit -v %lu && exec \"$0\" \"$@\"", (unsigned long)( mem_limit / 1024 ) );
+		const char* const shell[] = { "/bin/sh", "-c", script };
+		args.insert( args.begin(), shell, shell + 3 );
+	}
+	for ( const char* const* arg = argv + 1; *arg; ++arg ) args.push_back( *arg );
+	args.push_back( 0 );
+	
+	// only our end is non-blocking, the helper writes as usual
+	int fds[2];
+	if ( -1 == pipe2( fds, O_CLOEXEC ) ) return false;
+	
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init( &actions );
+	posix_spawn_file_actions_addopen( &actions, 0, "/dev/null", O_RDONLY, 0 );
+	posix_spawn_file_actions_adddup2( &actions, fds[1], 1 );
+	posix_spawn_file_actions_adddup2( &actions, fds[1], 2 );
+	
+	// don't pass on our signal handling
+	posix_spawnattr_t attr;
+	posix_spawnattr_init( &attr );
+	sigset_t sigs;
+	sigemptyset( &sigs );
+	posix_spawnattr_setsigmask( &attr, &sigs );
+	sigaddset( &sigs, SIGINT );
+	sigaddset( &sigs, SIGTERM );
+	sigaddset( &sigs, SIGPIPE );
+	posix_spawnattr_setsigdefault( &attr, &sigs );
+	posix_spawnattr_setflags( &attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF );
+	
+	// the helper gets the whole machine and normal timers, not our CPU and slack
+	pid_t pid = 0;
+	int err;
+	{
+		RealtimeSuspend normal_thread;
+		err = posix_spawn( &pid, args[0], &actions, &attr, (char* const*)&args[0], environ );
+	}
+	posix_spawnattr_destroy( &attr );
+	posix_spawn_file_actions_destroy( &actions );
+	close( fds[1] );
+	
+	if ( err ) {
+		close( fds[0] );
+		errno = err;
+		return false;
+	}
+	
+	pid_ = pid;
+	out_fd_ = fds[0];
+	fcntl( out_fd_, F_SETFL, O_NONBLOCK );
+	
+	// older kernels have no pidfds, so we fall back to polling for exit
+	pid_fd_ = syscall( __NR_pidfd_open, pid_, 0 );
+	
+	deadline_ms_ = monotonic_ms( ) + timeout_ms;
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// read output and reap the helper if it's finished, killing it if it's overrun
+bool HelperProcess::Poll( ) {
+	if ( !pid_ ) return true;
+	
+	readOutput_( );
+	reap_( WNOHANG );
+	
+	if ( pid_ && monotonic_ms( ) >= deadline_ms_ ) {
+		timed_out_ = true;
+		Kill( );
+	}
+	
+	return !pid_;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// kill the helper (if running) and reap it
+void HelperProcess::Kill( ) {
+	if ( pid_ ) {
+		kill( pid_, SIGKILL );
+		reap_( 0 );
+	}
+	closeFds_( );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// longest to wait before calling Poll() again (ms)
+int HelperProcess::WaitMs( ) const {
+	if ( !pid_ ) return 0;
+	
+	const unsigned long long now = monotonic_ms( );
+	const int remaining = ( deadline_ms_ > now ) ? deadline_ms_ - now : 0;
+	return ( -1 == pid_fd_ ) ? std::min( remaining, FALLBACK_POLL_MS ) : remaining;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// read whatever output is waiting
+void HelperProcess::readOutput_( ) {
+	if ( -1 == out_fd_ ) return;
+	
+	char buf[4096];
+	for ( ;; ) {
+		const ssize_t len = read( out_fd_, buf, sizeof(buf) );
+		if ( len > 0 ) {
+			if ( output_.size() < MAX_OUTPUT ) output_.append( buf, std::min( (size_t)len, MAX_OUTPUT - output_.size() ) );
+			continue;
+		}
+		if ( -1 == len && EINTR == errno ) continue;
+		
+		// end of output, don't keep waking up for it
+		if ( 0 == len ) {
+			close( out_fd_ );
+			out_fd_ = -1;
+		}
+		return;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// collect the helper's exit status if it's exited
+void HelperProcess::reap_( int options ) {
+	int status = 0;
+	pid_t res;
+	do {
+		res = waitpid( pid_, &status, options );
+	} while ( -1 == res && EINTR == errno );
+	if ( res == pid_ ) {
+		status_ = status;
+	} else if ( !( -1 == res && ECHILD == errno ) ) {
+		return; // still running
+	}
+	
+	// whatever it wrote before exiting
+	pid_ = 0;
+	readOutput_( );
+	closeFds_( );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// close the pipe and pidfd
+void HelperProcess::closeFds_( ) {
+	if ( -1 != out_fd_ ) close( out_fd_ );
+	if ( -1 != pid_fd_ ) close( pid_fd_ );
+	out_fd_ = pid_fd_ = -1;
+}
@@ -0,0 +1,105 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file helper_process.h
+///
+/// Time and memory bounded helper processes with non-blocking output
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_HELPER_PROCESS
+#define INCLUDED_HELPER_PROCESS
+
+//- includes
+#include <string>
+#include <stddef.h>
+#include <sys/types.h>
+
+/////////////////////////////////////////////////////////////////////////////
+/// runs a helper program without blocking on it
+///
+/// The helper is started with posix_spawn, with stdout and stderr going to
+/// a non-blocking pipe and its exit signalled through a pidfd. Wait on
+/// OutputFd() and ExitFd() along with anything else, and call Poll() when
+/// either is readable or the deadline passes. Helpers that overrun their
+/// time are killed. An address space limit is set by a shell that then
+/// execs the helper, so it holds from the helper's first instruction.
+class HelperProcess {
+public:
+	HelperProcess( );
+	~HelperProcess( );
+	
+	/// start a helper
+	/// @param argv Program (full path) and arguments, null terminated
+	/// @param timeout_ms Kill it after this long
+	/// @param mem_limit Address space limit in bytes (0 for none)
+	/// @return false (with errno set) if it couldn't be started
+	bool Start( const char* const argv[], int timeout_ms, size_t mem_limit );
+	
+	/// read output and reap the helper if it's finished, killing it if it's overrun
+	/// @return whether it's finished
+	bool Poll( );
+	
+	/// kill the helper (if running) and reap it
+	void Kill( );
+	
+	/// helper output (stdout and stderr), readable while running (-1 if none)
+	int OutputFd( ) const { return out_fd_; }
+	
+	/// readable when the helper exits (-1 if not running or pidfds aren't supported)
+	int ExitFd( ) const { return pid_fd_; }
+	
+	/// longest to wait before calling Poll() again (ms)
+	int WaitMs( ) const;
+	
+	/// is a helper running?
+	bool Running( ) const { return pid_ > 0; }
+	
+	/// output so far
+	const std::string& Output( ) const { return output_; }
+	
+	/// exit status (as from waitpid) of the last helper
+	int Status( ) const { return status_; }
+	
+	/// was the last helper killed for overrunning?
+	bool TimedOut( ) const { return timed_out_; }
+	
+private:
+	void readOutput_( );
+	void reap_( int options );
+	void closeFds_( );
+	
+	pid_t				pid_;			///< helper process (0 if none)
+	int					out_fd_;		///< read end of output pipe
+	int					pid_fd_;		///< pidfd of helper
+	unsigned long long	deadline_ms_;	///< when to kill it (CLOCK_MONOTONIC)
+	std::string			output_;		///< output so far
+	int					status_;		///< exit status
+	bool				timed_out_;		///< killed for overrunning?
+	
+	// no copying
+	HelperProcess( const HelperProcess& rhs );
+	const HelperProcess& operator=( const HelperProcess& rhs );
+};
+
+#endif // INCLUDED_HELPER_PROCESS
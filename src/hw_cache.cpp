@@ -0,0 +1,123 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file hw_cache.cpp
+///
+/// Cache of probed hardware locations
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+//- includes
+#include "hw_cache.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/// first line of a cache file (bump when the format changes)
+static const char HW_CACHE_MAGIC[] = "mediasmartserverd hw 1";
+
+/////////////////////////////////////////////////////////////////////////////
+/// read the first line of a file, without the newline
+static std::string read_line( const char* path ) {
+	char buf[128] = "";
+	FILE* f = fopen( path, "r" );
+	if ( !f ) return std::string( );
+	
+	if ( !fgets( buf, sizeof(buf), f ) ) buf[0] = 0;
+	fclose( f );
+	buf[ strcspn( buf, "\n" ) ] = 0;
+	return buf;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// build the key for this machine and boot
+std::string HwCache::Key( const std::string& vendor, const std::string& product ) {
+	const std::string boot_id = read_line( "/proc/sys/kernel/random/boot_id" );
+	if ( boot_id.empty() ) return std::string( ); // can't tell boots apart
+	
+	std::string key = vendor;
+	key += '\t';
+	key += product;
+	key += '\t';
+	key += boot_id;
+	
+	// keep it on one line
+	for ( size_t i = 0; i < key.size(); ++i ) {
+		if ( '\n' == key[i] || '\r' == key[i] ) key[i] = ' ';
+	}
+	return key;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// load the cache, failing if it's missing or was written for another key
+bool HwCache::Load( const char* path, const std::string& key ) {
+	if ( key.empty() ) return false;
+	
+	FILE* f = fopen( path, "r" );
+	if ( !f ) return false;
+	
+	bool magic = false, key_ok = false, have_board = false, have_gpio = false, have_sch = false;
+	char line[512];
+	while ( fgets( line, sizeof(line), f ) ) {
+		line[ strcspn( line, "\n" ) ] = 0;
+		
+		char name[32];
+		unsigned int val;
+		if ( !magic ) {
+			magic = ( 0 == strcmp( line, HW_CACHE_MAGIC ) );
+			if ( !magic ) break;
+		} else if ( 0 == strncmp( line, "key=", 4 ) ) {
+			key_ok = ( key == line + 4 );
+		} else if ( 0 == strncmp( line, "board=", 6 ) ) {
+			board = line + 6;
+			have_board = !board.empty();
+		} else if ( 2 == sscanf( line, "%31[^=]=%x", name, &val ) ) {
+			if ( 0 == strcmp( name, "gpiobase" ) ) { hw.gpiobase = val;     have_gpio = true; }
+			if ( 0 == strcmp( name, "sch5127"  ) ) { hw.sch5127_regs = val; have_sch  = true; }
+		}
+	}
+	fclose( f );
+	
+	return magic && key_ok && have_board && have_gpio && have_sch;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// write the cache (atomically replacing any existing one)
+bool HwCache::Save( const char* path, const std::string& key ) const {
+	if ( key.empty() ) return false;
+	
+	const std::string tmp_path = std::string( path ) + ".tmp";
+	FILE* f = fopen( tmp_path.c_str(), "w" );
+	if ( !f ) return false;
+	
+	fprintf( f, "%s\nkey=%s\nboard=%s\ngpiobase=%#x\nsch5127=%#x\n",
+		HW_CACHE_MAGIC, key.c_str(), board.c_str(), hw.gpiobase, hw.sch5127_regs );
+	
+	const bool written = !ferror( f );
+	if ( fclose( f ) || !written || rename( tmp_path.c_str(), path ) ) {
+		unlink( tmp_path.c_str() );
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,60 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file hw_cache.h
+///
+/// Cache of probed hardware locations
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_HW_CACHE
+#define INCLUDED_HW_CACHE
+
+//- includes
+#include "led_control_base.h"
+#include <string>
+
+/////////////////////////////////////////////////////////////////////////////
+/// cache of what hardware probing found, so later runs can skip it
+///
+/// Entries are keyed by the DMI vendor/product and the kernel boot id, so
+/// anything probed before the last reboot (or on other hardware) is never
+/// trusted.
+struct HwCache {
+	/// constructor
+	HwCache( ) { hw.gpiobase = hw.sch5127_regs = 0; }
+	
+	/// build the key for this machine and boot
+	static std::string Key( const std::string& vendor, const std::string& product );
+	
+	/// load the cache, failing if it's missing or was written for another key
+	bool Load( const char* path, const std::string& key );
+	
+	/// write the cache (atomically replacing any existing one)
+	bool Save( const char* path, const std::string& key ) const;
+	
+	std::string	board;	///< LED control interface name
+	LedHwInfo	hw;		///< where probing found it
+};
+
+#endif // INCLUDED_HW_CACHE
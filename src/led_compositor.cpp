@@ -0,0 +1,182 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file led_compositor.cpp
+///
+/// Merges LED intents from several sources into one frame
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+//- includes
+#include "led_compositor.h"
+#include <assert.h>
+
+/////////////////////////////////////////////////////////////////////////////
+/// holds a mutex for its lifetime
+class MutexLock {
+public:
+	explicit MutexLock( pthread_mutex_t& mutex ) : mutex_( mutex ) { pthread_mutex_lock( &mutex_ ); }
+	~MutexLock( ) { pthread_mutex_unlock( &mutex_ ); }
+	
+private:
+	pthread_mutex_t& mutex_;
+	
+	// no copying
+	MutexLock( const MutexLock& rhs );
+	const MutexLock& operator=( const MutexLock& rhs );
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// apply the parts of a layer's frame it claims on top of another
+static void overlay( LedFrame& out, const LedFrame& layer ) {
+	for ( size_t i = 0; i < LedFrame::MAX_BAYS; ++i ) {
+		if ( layer.bays   & ( 1U << i ) ) out.SetBay( i, layer.bay[i] );
+		if ( layer.blinks & ( 1U << i ) ) out.SetBayBlink( i, layer.bay_blink[i] );
+	}
+	
+	out.system      |= layer.system;
+	out.system_on    = ( out.system_on    & ~layer.system ) | ( layer.system_on    & layer.system );
+	out.system_blink = ( out.system_blink & ~layer.system ) | ( layer.system_blink & layer.system );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// the parts of a full frame that differ from another
+static LedFrame changes( const LedFrame& prev, const LedFrame& next ) {
+	LedFrame delta;
+	for ( size_t i = 0; i < LedFrame::MAX_BAYS; ++i ) {
+		if ( prev.bay[i]       != next.bay[i]       ) delta.SetBay( i, next.bay[i] );
+		if ( prev.bay_blink[i] != next.bay_blink[i] ) delta.SetBayBlink( i, next.bay_blink[i] );
+	}
+	
+	delta.system       = ( prev.system_on ^ next.system_on ) | ( prev.system_blink ^ next.system_blink );
+	delta.system_on    = next.system_on    & delta.system;
+	delta.system_blink = next.system_blink & delta.system;
+	return delta;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// constructor
+LedCompositor::LedCompositor( const LedControlPtr& leds )
+	:	leds_( leds )
+	,	written_( false )
+	,	generation_( 0 )
+{
+	assert( leds_ );
+	pthread_mutex_init( &mutex_, 0 );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// destructor
+LedCompositor::~LedCompositor( ) {
+	pthread_mutex_destroy( &mutex_ );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// replace a layer's intents
+void LedCompositor::Publish( LedLayer layer, const LedFrame& frame ) {
+	assert( layer >= 0 && layer < LAYER_CNT );
+	
+	MutexLock lock( mutex_ );
+	layers_[layer] = frame;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// drop a layer's intents
+void LedCompositor::Clear( LedLayer layer ) {
+	Publish( layer, LedFrame( ) );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// drop every layer's intents
+void LedCompositor::Reset( ) {
+	MutexLock lock( mutex_ );
+	for ( size_t i = 0; i < LAYER_CNT; ++i ) layers_[i] = LedFrame( );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// merge the layers and write whatever changed
+void LedCompositor::Commit( ) {
+	MutexLock lock( mutex_ );
+	
+	// start with everything off, then each layer in turn
+	LedFrame merged;
+	for ( size_t i = 0; i < LedFrame::MAX_BAYS; ++i ) {
+		merged.SetBay( i, 0 );
+		merged.SetBayBlink( i, 0 );
+	}
+	merged.SetSystem( LED_BLUE | LED_RED, LED_OFF );
+	for ( size_t i = 0; i < LAYER_CNT; ++i ) overlay( merged, layers_[i] );
+	
+	// only pass on what changed
+	const LedFrame delta = ( written_ ) ? changes( output_, merged ) : merged;
+	if ( delta.bays || delta.blinks || delta.system ) {
+		leds_->SetFrame( delta );
+		++generation_;
+	}
+	
+	output_ = merged;
+	written_ = true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// set LED brightness
+void LedCompositor::SetBrightness( int val ) {
+	MutexLock lock( mutex_ );
+	leds_->SetBrightness( val );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// turn USB power on or off
+void LedCompositor::MountUsb( bool state ) {
+	MutexLock lock( mutex_ );
+	leds_->MountUsb( state );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// the merged frame last written
+LedFrame LedCompositor::Output( ) const {
+	MutexLock lock( mutex_ );
+	return output_;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// bumped whenever a commit changes the LEDs
+unsigned long long LedCompositor::Generation( ) const {
+	MutexLock lock( mutex_ );
+	return generation_;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// how often BlinkTick() needs calling, or 0 if nothing blinks in software
+int LedCompositor::SoftBlinkInterval( ) const {
+	MutexLock lock( mutex_ );
+	return leds_->SoftBlinkInterval( );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// toggle LEDs blinking in software
+void LedCompositor::BlinkTick( ) {
+	MutexLock lock( mutex_ );
+	leds_->BlinkTick( );
+}
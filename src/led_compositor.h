@@ -0,0 +1,108 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file led_compositor.h
+///
+/// Merges LED intents from several sources into one frame
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_LED_COMPOSITOR
+#define INCLUDED_LED_COMPOSITOR
+
+//- includes
+#include "led_control_base.h"
+#include <pthread.h>
+
+//- constants
+/// LED layers, lowest priority first
+enum LedLayer {
+	LAYER_PRESENCE	= 0,	///< bays with a disk in them
+	LAYER_ACTIVITY,			///< disk activity
+	LAYER_HEALTH,			///< health alerts
+	LAYER_UPDATE,			///< update status
+	LAYER_OVERRIDE,			///< manual overrides (light shows, locate, ...)
+	LAYER_CNT,
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// merges LED intents from several sources into one frame
+///
+/// Each source publishes a LedFrame to its own layer. Only the parts a
+/// frame includes (bays, bay blinking, system LED colours) are claimed, and
+/// higher layers win where claims overlap. Anything no layer claims is off.
+/// Commit() works out the merged frame and hands only what changed since
+/// the last commit to the hardware.
+///
+/// All calls are serialised, so sources on other threads can publish and
+/// commit directly.
+class LedCompositor {
+public:
+	explicit LedCompositor( const LedControlPtr& leds );
+	~LedCompositor( );
+	
+	/// replace a layer's intents
+	void Publish( LedLayer layer, const LedFrame& frame );
+	
+	/// drop a layer's intents
+	void Clear( LedLayer layer );
+	
+	/// drop every layer's intents
+	void Reset( );
+	
+	/// merge the layers and write whatever changed
+	void Commit( );
+	
+	/// set LED brightness (see LedControlBase::SetBrightness)
+	void SetBrightness( int val );
+	
+	/// turn USB power on or off (see LedControlBase::MountUsb)
+	void MountUsb( bool state );
+	
+	/// the merged frame last written
+	LedFrame Output( ) const;
+	
+	/// bumped whenever a commit changes the LEDs
+	unsigned long long Generation( ) const;
+	
+	/// how often BlinkTick() needs calling, or 0 if nothing blinks in software
+	int SoftBlinkInterval( ) const;
+	
+	/// toggle LEDs blinking in software
+	void BlinkTick( );
+	
+private:
+	LedControlPtr			leds_;				///< led control interface
+	mutable pthread_mutex_t	mutex_;				///< serialises everything
+	LedFrame				layers_[LAYER_CNT];	///< what each layer wants
+	LedFrame				output_;			///< what we last wrote
+	bool					written_;			///< written anything yet?
+	unsigned long long		generation_;		///< commits that changed something
+	
+	// no copying
+	LedCompositor( const LedCompositor& rhs );
+	const LedCompositor& operator=( const LedCompositor& rhs );
+};
+typedef std::tr1::shared_ptr< LedCompositor > LedCompositorPtr;
+
+#endif // INCLUDED_LED_COMPOSITOR
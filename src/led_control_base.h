@@ -31,6 +31,7 @@
 #define INCLUDED_LED_CONTROL_BASE
 
 //- includes
+#include <stddef.h>
 #include <tr1/memory>
 
 //- constants
@@ -45,6 +46,59 @@ enum LedState {
 	LED_BLINK	= 1 << 2,
 };
 
+/////////////////////////////////////////////////////////////////////////////
+/// desired state of all bay and system LEDs, applied with SetFrame()
+struct LedFrame {
+	static const size_t MAX_BAYS = 8;
+	
+	/// constructor (an empty frame doesn't touch any LEDs)
+	LedFrame( )
+		:	bays( 0 )
+		,	blinks( 0 )
+		,	system( 0 )
+		,	system_on( 0 )
+		,	system_blink( 0 )
+	{
+		for ( size_t i = 0; i < MAX_BAYS; ++i ) bay[i] = bay_blink[i] = 0;
+	}
+	
+	/// light the given colours of a bay and turn the others off
+	void SetBay( size_t led_idx, int led_type ) {
+		if ( led_idx >= MAX_BAYS ) return;
+		bays |= 1U << led_idx;
+		bay[led_idx] = led_type;
+	}
+	
+	/// blink the given colours of a bay and stop the others blinking
+	void SetBayBlink( size_t led_idx, int led_type ) {
+		if ( led_idx >= MAX_BAYS ) return;
+		blinks |= 1U << led_idx;
+		bay_blink[led_idx] = led_type;
+	}
+	
+	/// set the state of some system LED colours
+	void SetSystem( int led_type, LedState state ) {
+		system |= led_type;
+		system_on    = ( LED_ON    == state ) ? system_on    | led_type : system_on    & ~led_type;
+		system_blink = ( LED_BLINK == state ) ? system_blink | led_type : system_blink & ~led_type;
+	}
+	
+	unsigned int	bays;			///< bays included in the frame (bit per bay)
+	int				bay[MAX_BAYS];	///< colours lit per bay (LED_BLUE | LED_RED)
+	unsigned int	blinks;			///< bays whose blinking is included in the frame (bit per bay)
+	int				bay_blink[MAX_BAYS];	///< colours blinking per bay
+	int				system;			///< system LED colours included in the frame
+	int				system_on;		///< system LED colours turned on
+	int				system_blink;	///< system LED colours blinking
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// hardware locations found while probing (see InitCached)
+struct LedHwInfo {
+	unsigned int	gpiobase;		///< I/O base of the LPC GPIO registers
+	unsigned int	sch5127_regs;	///< I/O base of the SCH5127 runtime registers
+};
+
 /////////////////////////////////////////////////////////////////////////////
 /// base class for LED control (if we support anything more than the 48x)
 class LedControlBase {
@@ -54,19 +108,59 @@ public:
 	virtual const char* Desc( ) const = 0;
 	virtual bool Init( ) = 0;
 	
+	/// initialise from locations an earlier Init found, without probing
+	virtual bool InitCached( const LedHwInfo& ) { return Init( ); }
+	
+	/// hardware locations found by Init (to pass to InitCached next time)
+	virtual LedHwInfo HwInfo( ) const { LedHwInfo info = { 0, 0 }; return info; }
+	
 	virtual void MountUsb( bool state ) = 0;
 	virtual void Set( int led_type, size_t led_idx, bool state ) = 0;
 	virtual void SetBrightness( int val ) = 0;
 	virtual void SetSystemLed( int led_type, LedState state ) = 0;
 	
+	/// make bay LED colours blink, regardless of their on/off state, or stop
+	virtual void SetBlink( int /*led_type*/, size_t /*led_idx*/, bool /*state*/ ) { }
+	
+	/// how often BlinkTick() needs calling, or 0 if nothing blinks in software
+	virtual int SoftBlinkInterval( ) const { return 0; }
+	
+	/// toggle LEDs blinking in software
+	virtual void BlinkTick( ) { }
+	
 	/// wrapper if someone gives us a bool
 	virtual void SetSystemLed( int led_type, bool state ) {
 		SetSystemLed( led_type, ( state ) ? LED_ON : LED_OFF );
 	}
 	
+	/// set the state of every LED in the frame at once
+	virtual void SetFrame( const LedFrame& frame ) {
+		for ( size_t i = 0; i < LedFrame::MAX_BAYS; ++i ) {
+			if ( !( frame.bays & ( 1U << i ) ) ) continue;
+			Set(  frame.bay[i], i, true );
+			Set( ~frame.bay[i] & ( LED_BLUE | LED_RED ), i, false );
+		}
+		for ( size_t i = 0; i < LedFrame::MAX_BAYS; ++i ) {
+			if ( !( frame.blinks & ( 1U << i ) ) ) continue;
+			SetBlink(  frame.bay_blink[i], i, true );
+			SetBlink( ~frame.bay_blink[i] & ( LED_BLUE | LED_RED ), i, false );
+		}
+		setFrameSystem_( frame );
+	}
+	
 protected:
 	LedControlBase( ) { }
 	
+	/// apply the system LED part of a frame
+	void setFrameSystem_( const LedFrame& frame ) {
+		const int colours[] = { LED_BLUE, LED_RED };
+		for ( size_t i = 0; i < sizeof(colours) / sizeof(colours[0]); ++i ) {
+			const int c = colours[i];
+			if ( !( frame.system & c ) ) continue;
+			SetSystemLed( c, ( frame.system_blink & c ) ? LED_BLINK : ( frame.system_on & c ) ? LED_ON : LED_OFF );
+		}
+	}
+	
 private:
 	// no copying
 	LedControlBase( const LedControlBase& rhs );
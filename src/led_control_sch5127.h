@@ -0,0 +1,283 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file led_control_sch5127.h
+///
+/// LED control for boards using the SCH5127 chipset, driven by board traits
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_LED_CONTROL_SCH5127
+#define INCLUDED_LED_CONTROL_SCH5127
+
+//- includes
+#include "led_control_sch5127_base.h"
+
+/////////////////////////////////////////////////////////////////////////////
+/// LED control for boards using the SCH5127 chipset
+///
+/// Everything that differs between boards (PCI ID, pin assignments, where
+/// the bay LEDs are wired) comes from a Board traits struct as compile time
+/// constants, so the register and bitmask of every bay LED is worked out by
+/// the compiler and Set() becomes a table lookup and a masked write.
+///
+/// Board must provide:
+///  - static const char* Desc( )
+///  - PCI_DID_VID		expected LPC bridge device and vendor id
+///  - BAYS_ON_SCH5127	bay LEDs on SCH5127 GP registers (1) or ICH9 GPIO (0)
+///  - OUT_BLUE0..3, OUT_RED0..3	bay LED pins
+///  - OUT_USB_DEVICE, OUT_SYSTEM_BLUE, OUT_SYSTEM_RED	ICH9 GPIO pins
+///  - GPIO_OUTPUTS1, GPIO_OUTPUTS2	extra ICH9 GPIOs [31:0] and [60:32] to enable
+template < typename Board >
+class LedControlSCH5127 : public LedControlSCH5127Base {
+public:
+	/// constructor
+	LedControlSCH5127( ) { }
+	
+	/// destructor
+	virtual ~LedControlSCH5127( ) { }
+	
+	/////////////////////////////////////////////////////////////////////////
+	const char* Desc( ) const { return Board::Desc( ); }
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// attempt to initialise device
+	virtual bool Init( ) {
+		// initialise SCH5127
+		if ( !LedControlSCH5127Base::Init() ) return false;
+		
+		return initLeds_( );
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// initialise device from previously probed I/O bases
+	virtual bool InitCached( const LedHwInfo& info ) {
+		if ( !LedControlSCH5127Base::InitCached( info ) ) return false;
+		
+		return initLeds_( );
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// set system LED (off, on, or blink)
+	virtual void SetSystemLed( int led_type, LedState state ) {
+		const bool on_off_state = ( LED_ON == state );
+		if ( led_type & LED_BLUE ) setLpcPin_( LpcPin< Board::OUT_SYSTEM_BLUE >::REG, LpcPin< Board::OUT_SYSTEM_BLUE >::MASK, !on_off_state );
+		if ( led_type & LED_RED  ) setLpcPin_( LpcPin< Board::OUT_SYSTEM_RED  >::REG, LpcPin< Board::OUT_SYSTEM_RED  >::MASK, !on_off_state );
+		
+		const bool blink_state  = ( LED_BLINK == state );
+		unsigned int val = 0;
+		if ( led_type & LED_BLUE ) val |= LpcPin< Board::OUT_SYSTEM_BLUE >::MASK;
+		if ( led_type & LED_RED  ) val |= LpcPin< Board::OUT_SYSTEM_RED  >::MASK;
+		if ( val ) setGpLpcBlink_( val, blink_state );
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// (un)mount USB device
+	virtual void MountUsb( bool state ) {
+		setLpcPin_( LpcPin< Board::OUT_USB_DEVICE >::REG, LpcPin< Board::OUT_USB_DEVICE >::MASK, state );
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// set brightness level
+	/// @param val Brightness level from 0 to 9
+	virtual void SetBrightness( int val ) {
+		static const unsigned char LED_BRIGHTNESS[] = {
+			0x00, 0xbe, 0xc3, 0xcb, 0xd3, 0xdb, 0xe3, 0xeb, 0xf3, 0xff
+		};
+		val = std::max( 0, std::min<int>( val, sizeof(LED_BRIGHTNESS) / sizeof(LED_BRIGHTNESS[0]) - 1 ) );
+		
+		outB_( HWM_PWM3_DUTY_CYCLE, io_sch5127_regs_ + REG_HWM_INDEX );
+		outB_( LED_BRIGHTNESS[val], io_sch5127_regs_ + REG_HWM_DATA  );
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// control leds
+	/// @param led_type LED type to turn on/off LED_BLUE, LED_RED, LED_BLUE | LED_RED
+	/// @param led_idx Which LED to turn on/off (0 -> 3)
+	/// @param state Whether we are turning LED on (true) or off (false)
+	virtual void Set( int led_type, size_t led_idx, bool state ) {
+		if ( led_idx >= MAX_HDD_LEDS ) return;
+		
+		// both colours of a bay often share a register, so write it once
+		const BayPins& pins = bayPins_( )[ led_idx ];
+		batching_ = true;
+		if ( led_type & LED_BLUE ) setBayPin_( pins.blue, state );
+		if ( led_type & LED_RED  ) setBayPin_( pins.red,  state );
+		batching_ = false;
+		flushRegs_( );
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// make bay LEDs blink (in hardware where the pin allows it)
+	/// @param led_type LED type to start/stop blinking LED_BLUE, LED_RED, LED_BLUE | LED_RED
+	/// @param led_idx Which bay (0 -> 3)
+	/// @param state Whether we are starting (true) or stopping (false) blinking
+	virtual void SetBlink( int led_type, size_t led_idx, bool state ) {
+		if ( led_idx >= MAX_HDD_LEDS ) return;
+		
+		const BayPins& pins = bayPins_( )[ led_idx ];
+		batching_ = true;
+		if ( led_type & LED_BLUE ) setBlinkBits_( pins.blue.reg, pins.blue.mask, state );
+		if ( led_type & LED_RED  ) setBlinkBits_( pins.red.reg,  pins.red.mask,  state );
+		batching_ = false;
+		flushRegs_( );
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// set the state of every LED in the frame at once
+	virtual void SetFrame( const LedFrame& frame ) {
+		batching_ = true;
+		for ( size_t i = 0; i < MAX_HDD_LEDS; ++i ) {
+			const BayPins& pins = bayPins_( )[ i ];
+			if ( frame.bays & ( 1U << i ) ) {
+				setBayPin_( pins.blue, !!( frame.bay[i] & LED_BLUE ) );
+				setBayPin_( pins.red,  !!( frame.bay[i] & LED_RED  ) );
+			}
+			if ( frame.blinks & ( 1U << i ) ) {
+				setBlinkBits_( pins.blue.reg, pins.blue.mask, !!( frame.bay_blink[i] & LED_BLUE ) );
+				setBlinkBits_( pins.red.reg,  pins.red.mask,  !!( frame.bay_blink[i] & LED_RED  ) );
+			}
+		}
+		setFrameSystem_( frame );
+		batching_ = false;
+		flushRegs_( );
+	}
+	
+protected:
+	static const size_t MAX_HDD_LEDS = 4;
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// register and mask of an ICH9 GPIO pin (GP_LVL or GP_LVL2)
+	template < int BIT >
+	struct LpcPin {
+		enum {
+			REG		= ( BIT < 32 ) ? SHADOW_GP_LVL : SHADOW_GP_LVL2,
+		};
+		static const unsigned int MASK = 1U << ( BIT % 32 );
+	};
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// register and mask of an SCH5127 GP pin (see setGpRegsLvl_ for encoding)
+	template < int BIT >
+	struct Sch5127Pin {
+		enum {
+			REG		= SHADOW_GP1 + ( ( BIT >> 4 ) & 0xF ) - 1 + ( ( BIT >> 3 ) & 0x1 ),
+		};
+		static const unsigned int MASK = 1U << ( BIT & 0x7 );
+	};
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// register and mask of a bay LED pin, wherever the board wires them
+	template < int BIT >
+	struct BayPin {
+		enum {
+			REG		= ( Board::BAYS_ON_SCH5127 ) ? (int)Sch5127Pin< BIT >::REG : (int)LpcPin< BIT >::REG,
+		};
+		static const unsigned int MASK = ( Board::BAYS_ON_SCH5127 ) ? Sch5127Pin< BIT >::MASK : LpcPin< BIT >::MASK;
+	};
+	
+	/// shadow register index and bitmask of a single pin
+	struct Pin {
+		unsigned int reg;
+		unsigned int mask;
+	};
+	
+	/// pins of a bay's LEDs
+	struct BayPins {
+		Pin blue;
+		Pin red;
+	};
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// is this an expected PCI device and vnedor id?
+	virtual bool chkPciDeviceVendorId_( unsigned int did_vid ) const {
+		return ( (unsigned int)Board::PCI_DID_VID == did_vid );
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// bay LED mappings (worked out at compile time)
+	static const BayPins* bayPins_( ) {
+		static const BayPins BAY_PINS[ MAX_HDD_LEDS ] = {
+			{ { BayPin< Board::OUT_BLUE0 >::REG, BayPin< Board::OUT_BLUE0 >::MASK }, { BayPin< Board::OUT_RED0 >::REG, BayPin< Board::OUT_RED0 >::MASK } },
+			{ { BayPin< Board::OUT_BLUE1 >::REG, BayPin< Board::OUT_BLUE1 >::MASK }, { BayPin< Board::OUT_RED1 >::REG, BayPin< Board::OUT_RED1 >::MASK } },
+			{ { BayPin< Board::OUT_BLUE2 >::REG, BayPin< Board::OUT_BLUE2 >::MASK }, { BayPin< Board::OUT_RED2 >::REG, BayPin< Board::OUT_RED2 >::MASK } },
+			{ { BayPin< Board::OUT_BLUE3 >::REG, BayPin< Board::OUT_BLUE3 >::MASK }, { BayPin< Board::OUT_RED3 >::REG, BayPin< Board::OUT_RED3 >::MASK } },
+		};
+		return BAY_PINS;
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// set/clear an ICH9 GPIO level
+	void setLpcPin_( size_t reg, unsigned int mask, bool state ) {
+		doBits_( reg, mask, state );
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// turn a bay LED on/off
+	void setBayPin_( const Pin& pin, bool state ) {
+		// ICH9 GPIO bay LEDs are active low
+		doBits_( pin.reg, pin.mask, ( Board::BAYS_ON_SCH5127 ) ? state : !state );
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// get access to the remaining ports we use and enable the LEDs
+	bool initLeds_( ) {
+		// set up io permissions to other ports we may use
+		if ( port_io->Perm(io_sch5127_regs_ + REG_HWM_INDEX, 1, 1) ) throw ErrnoException("ioperm");
+		if ( port_io->Perm(io_sch5127_regs_ + REG_HWM_DATA,  1, 1) ) throw ErrnoException("ioperm");
+		
+		//
+		if ( port_io->Perm(io_lpc_gpiobase_ + GP_IO_SEL,	4, 1) ) throw ErrnoException("ioperm");
+		if ( port_io->Perm(io_lpc_gpiobase_ + GP_IO_SEL2,	4, 1) ) throw ErrnoException("ioperm");
+		
+		enableLeds_( );
+		
+		// the level registers only read back the output latches now
+		initShadows_( );
+		
+		return true;
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// enable LEDs
+	void enableLeds_( ) {
+		// work out which bits we need
+		int bits1 = Board::GPIO_OUTPUTS1, bits2 = Board::GPIO_OUTPUTS2;
+		if ( !Board::BAYS_ON_SCH5127 ) {
+			const BayPins* pins = bayPins_( );
+			for ( size_t i = 0; i < MAX_HDD_LEDS; ++i ) {
+				( ( SHADOW_GP_LVL2 == pins[i].blue.reg ) ? bits2 : bits1 ) |= pins[i].blue.mask;
+				( ( SHADOW_GP_LVL2 == pins[i].red.reg  ) ? bits2 : bits1 ) |= pins[i].red.mask;
+			}
+		}
+		setBit32_( Board::OUT_USB_DEVICE,  bits1, bits2 );
+		setBit32_( Board::OUT_SYSTEM_BLUE, bits1, bits2 );
+		setBit32_( Board::OUT_SYSTEM_RED,  bits1, bits2 );
+		
+		setGpioSelInput_( bits1, bits2 );
+		
+		//TODO: SCH5127 bits
+	}
+};
+
+#endif // INCLUDED_LED_CONTROL_SCH5127
@@ -32,11 +32,12 @@
 
 //- includes
 #include "led_control_base.h"
+#include "loop_profile.h"
 #include "mediasmartserverd.h"
+#include "port_io.h"
 #include <algorithm>
 #include <assert.h>
 #include <iostream>
-#include <sys/io.h>
 
 /////////////////////////////////////////////////////////////////////////////
 /// base class for LED control over systems using the SCH5127 chipset
@@ -46,7 +47,14 @@ public:
 	LedControlSCH5127Base( )
 		:	io_lpc_gpiobase_( 0 )
 		,	io_sch5127_regs_( 0 )
-	{ }
+		,	dirty_( 0 )
+		,	batching_( false )
+		,	blink_phase_( false )
+	{
+		std::fill( shadow_,     shadow_     + SHADOW_CNT, 0 );
+		std::fill( pending_,    pending_    + SHADOW_CNT, 0 );
+		std::fill( soft_blink_, soft_blink_ + SHADOW_CNT, 0 );
+	}
 	
 	/// destructor
 	virtual ~LedControlSCH5127Base( ) { }
@@ -62,7 +70,64 @@ public:
 		return true;
 	}
 	
+	/////////////////////////////////////////////////////////////////////////
+	/// initialise from previously probed I/O bases
+	///
+	/// Skips the PCI and SuperI/O probing and the watchdog write, which an
+	/// earlier Init has already done since boot.
+	virtual bool InitCached( const LedHwInfo& info ) {
+		// same sanity checks as probing would have made
+		if ( !info.gpiobase || ( info.gpiobase & 0xFFFF007F ) ) return false;
+		if ( !info.sch5127_regs || info.sch5127_regs > 0xFFFF ) return false;
+		
+		io_lpc_gpiobase_ = info.gpiobase;
+		io_sch5127_regs_ = info.sch5127_regs;
+		
+		return true;
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// I/O bases found by Init
+	virtual LedHwInfo HwInfo( ) const {
+		LedHwInfo info = { io_lpc_gpiobase_, io_sch5127_regs_ };
+		return info;
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// set the state of every LED in the frame at once
+	///
+	/// Changes are collected in the pending registers and each register
+	/// that differs afterwards is written exactly once.
+	virtual void SetFrame( const LedFrame& frame ) {
+		batching_ = true;
+		LedControlBase::SetFrame( frame );
+		batching_ = false;
+		flushRegs_( );
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// how often BlinkTick() needs calling, or 0 if nothing blinks in software
+	virtual int SoftBlinkInterval( ) const {
+		for ( size_t i = 0; i < SHADOW_CNT; ++i ) {
+			if ( soft_blink_[i] ) return SOFT_BLINK_MS;
+		}
+		return 0;
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// toggle LEDs blinking in software
+	virtual void BlinkTick( ) {
+		blink_phase_ = !blink_phase_;
+		for ( size_t i = 0; i < SHADOW_CNT; ++i ) {
+			if ( soft_blink_[i] ) dirty_ |= 1U << i;
+		}
+		if ( !batching_ ) flushRegs_( );
+	}
+	
 protected:
+	/// half period of software blinking (matches the ICH9 hardware blink)
+	static const int SOFT_BLINK_MS = 500;
+	
 	/////////////////////////////////////////////////////////////////////////
 	/// IHR9 General Purpose I/O Registers
 	enum {
@@ -92,6 +157,7 @@ protected:
 		REG_GP4				= 0x4E,	///< General Purpose I/O Data Register 4
 		REG_GP5				= 0x4F,	///< General Purpose I/O Data Register 5
 		REG_GP6				= 0x50,	///< General Purpose I/O Data Register 6
+		GP_REGS_CNT			= REG_GP6 - REG_GP1 + 1,
 		
 		REG_WDT_TIME_OUT	= 0x65,	///< Watch-dog Timeout
 		REG_WDT_VAL			= 0x66,	///< Watch-dog Timer Time-out Value
@@ -102,6 +168,15 @@ protected:
 		REG_HWM_DATA		= 0x71,	///< HWM Data Register (SCH5127 runtime register)
 	};
 	
+	/// output registers we keep shadow copies of
+	enum {
+		SHADOW_GP_LVL		= 0,	///< ICH9 GP_LVL (32 bit)
+		SHADOW_GP_LVL2,				///< ICH9 GP_LVL2 (32 bit)
+		SHADOW_GPO_BLINK,			///< ICH9 GPO_BLINK (32 bit)
+		SHADOW_GP1,					///< SCH5127 REG_GP1 - REG_GP6 (8 bit)
+		SHADOW_CNT			= SHADOW_GP1 + GP_REGS_CNT,
+	};
+	
 	/// SCH5127 Hardware monitoring register set
 	enum {
 		HWM_PWM3_DUTY_CYCLE	= 0x32,	///< PWM3 Current Duty Cycle
@@ -126,17 +201,17 @@ protected:
 		const unsigned int PCI_CONFIG_DATA		= 0x0CFC;
 		
 		//
-		if ( ioperm(PCI_CONFIG_DATA,    4, 1) ) throw ErrnoException("ioperm");
-		if ( ioperm(PCI_CONFIG_ADDRESS, 4, 1) ) throw ErrnoException("ioperm");
+		if ( port_io->Perm(PCI_CONFIG_DATA,    4, 1) ) throw ErrnoException("ioperm");
+		if ( port_io->Perm(PCI_CONFIG_ADDRESS, 4, 1) ) throw ErrnoException("ioperm");
 		
 		// retrieve vendor and device identification
-		outl( CONF_VENDOR_ID, PCI_CONFIG_ADDRESS );
-		const unsigned int did_vid = inl( PCI_CONFIG_DATA );
+		outL_( CONF_VENDOR_ID, PCI_CONFIG_ADDRESS );
+		const unsigned int did_vid = inL_( PCI_CONFIG_DATA );
 		if ( !chkPciDeviceVendorId_(did_vid) ) return false;
 		
 		// retrieve GPIO Base Address
-		outl( CONF_GPIOBASE, PCI_CONFIG_ADDRESS );
-		io_lpc_gpiobase_ = inl( PCI_CONFIG_DATA );
+		outL_( CONF_GPIOBASE, PCI_CONFIG_ADDRESS );
+		io_lpc_gpiobase_ = inL_( PCI_CONFIG_DATA );
 		
 		// sanity check the address
 		// (only bits 15:6 provide an address while the rest are reserved as always being zero)
@@ -147,8 +222,8 @@ protected:
 		io_lpc_gpiobase_ &= ~0x1; // remove hardwired 1 which indicates I/O space
 		
 		// finished with these ports
-		ioperm( PCI_CONFIG_DATA,    4, 0 );
-		ioperm( PCI_CONFIG_ADDRESS, 4, 0 );
+		port_io->Perm( PCI_CONFIG_DATA,    4, 0 );
+		port_io->Perm( PCI_CONFIG_ADDRESS, 4, 0 );
 		
 		return true;
 	}	
@@ -168,58 +243,58 @@ protected:
 		// try LPC SIO @ 0x2e
 		unsigned int sio_addr = 0x2e;
 		unsigned int sio_data = sio_addr + 1;
-		if ( ioperm(sio_addr, 1, 1) ) throw ErrnoException("ioperm");
-		if ( ioperm(sio_data, 1, 1) ) throw ErrnoException("ioperm");
+		if ( port_io->Perm(sio_addr, 1, 1) ) throw ErrnoException("ioperm");
+		if ( port_io->Perm(sio_data, 1, 1) ) throw ErrnoException("ioperm");
 		
 		// enter configuration mode
-		outb( IDX_ENTER, sio_addr );
+		outB_( IDX_ENTER, sio_addr );
 		
 		// retrieve identification
-		outb( IDX_ID, sio_addr );
-		const unsigned int device_id = inb( sio_data );
+		outB_( IDX_ID, sio_addr );
+		const unsigned int device_id = inB_( sio_data );
 		if ( debug ) std::cout << Desc() << ": Device 0x" << std::hex << device_id << std::dec << "\n";
 		
 		// 
 		{
-			outb( 0x26, sio_addr );
-			const unsigned int in = inb( sio_data );
+			outB_( 0x26, sio_addr );
+			const unsigned int in = inB_( sio_data );
 			if ( 0x4e == in ) {
-				outb( IDX_EXIT, sio_addr );
+				outB_( IDX_EXIT, sio_addr );
 				
 				// finished with these ports
-				ioperm( sio_addr, 1, 0 );
-				ioperm( sio_data, 1, 0 );
+				port_io->Perm( sio_addr, 1, 0 );
+				port_io->Perm( sio_data, 1, 0 );
 				
 				// and switch to these if we are told to
 				if ( debug ) std::cout << Desc() << ": Using 0x4e\n";
 				sio_addr = 0x4e;
 				sio_data = sio_addr + 1;
 				
-				if ( ioperm(sio_addr, 1, 1) ) throw ErrnoException("ioperm");
-		        if ( ioperm(sio_data, 1, 1) ) throw ErrnoException("ioperm");
+				if ( port_io->Perm(sio_addr, 1, 1) ) throw ErrnoException("ioperm");
+		        if ( port_io->Perm(sio_data, 1, 1) ) throw ErrnoException("ioperm");
 				
-				outb( IDX_ENTER, sio_addr );
+				outB_( IDX_ENTER, sio_addr );
 			}
 		}
 		
 		// select logical device 0x0a (base address?)
-		outb( IDX_LDN, sio_addr );
-		outb( 0x0a, sio_data );
+		outB_( IDX_LDN, sio_addr );
+		outB_( 0x0a, sio_data );
 		
 		// get base address of runtime registers
-		outb( IDX_BASE_MSB, sio_addr );
-		const unsigned int index_msb = inb( sio_data );
-		outb( IDX_BASE_LSB, sio_addr );
-		const unsigned int index_lsb = inb( sio_data );
+		outB_( IDX_BASE_MSB, sio_addr );
+		const unsigned int index_msb = inB_( sio_data );
+		outB_( IDX_BASE_LSB, sio_addr );
+		const unsigned int index_lsb = inB_( sio_data );
 		
 		io_sch5127_regs_ = index_msb << 8 | index_lsb;
 		
 		// exit configuration
-		outb( IDX_EXIT, sio_addr );
+		outB_( IDX_EXIT, sio_addr );
 		
 		// finished with SuperI/O ports
-		ioperm(sio_data, 1, 0);
-		ioperm(sio_addr, 1, 0);
+		port_io->Perm(sio_data, 1, 0);
+		port_io->Perm(sio_addr, 1, 0);
 		
 		return true;
 	}
@@ -237,53 +312,175 @@ protected:
 		const int reg_cnt = reg_max - reg_min + 1;
 		
 		// get access to the entire range
-		if ( ioperm(io_sch5127_regs_ + reg_min, reg_cnt, 1) ) throw ErrnoException("ioperm");
+		if ( port_io->Perm(io_sch5127_regs_ + reg_min, reg_cnt, 1) ) throw ErrnoException("ioperm");
 		
 		// zero them out
 		for ( size_t i = 0; i < WDT_REGS_CNT; ++i ) {
-			outb( 0, io_sch5127_regs_ + WDT_REGS[i] );
+			outB_( 0, io_sch5127_regs_ + WDT_REGS[i] );
 		}
 		
 		// done
-		ioperm(io_sch5127_regs_ + reg_min, reg_cnt, 0);
+		port_io->Perm(io_sch5127_regs_ + reg_min, reg_cnt, 0);
 	}
 	
 	/////////////////////////////////////////////////////////////////////////
 	static void setBit32_( int bit, int& bits1, int& bits2 ) {
 		int& bits = (bit < 32) ? bits1 : bits2;
-		bits |= 1 << bit;
+		bits |= 1U << (bit % 32);
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// populate shadow copies of the output registers we drive
+	///
+	/// All LED changes are made to pending copies and only registers whose
+	/// pending value differs from the shadow are written, so unchanged LEDs
+	/// cost no bus access at all and changed ones a single write.
+	///
+	/// Only call this once the LED pins are GPIO outputs: before that GP_LVL
+	/// reads back the sensed pin level rather than the output latch.
+	void initShadows_( ) {
+		if ( port_io->Perm(io_lpc_gpiobase_ + GP_LVL,    4, 1) ) throw ErrnoException("ioperm");
+		if ( port_io->Perm(io_lpc_gpiobase_ + GP_LVL2,   4, 1) ) throw ErrnoException("ioperm");
+		if ( port_io->Perm(io_lpc_gpiobase_ + GPO_BLINK, 4, 1) ) throw ErrnoException("ioperm");
+		if ( port_io->Perm(io_sch5127_regs_ + REG_GP1, GP_REGS_CNT, 1) ) throw ErrnoException("ioperm");
+		
+		for ( size_t i = 0; i < SHADOW_CNT; ++i ) {
+			shadow_[i] = pending_[i] = ( i < SHADOW_GP1 )
+				?	inL_( shadowPort_(i), i )
+				:	inB_( shadowPort_(i), i );
+		}
+		dirty_ = 0;
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// port I/O, counted in the loop profile by shadow register (every
+	/// access goes through these, so nothing is missed or counted twice)
+	/// @param profile_reg Shadow register the port belongs to, if any
+	unsigned int inB_( unsigned int port, size_t profile_reg = LoopProfile::PORT_OTHER ) {
+		++loop_profile.port_reads[profile_reg];
+		return port_io->InB( port );
+	}
+	unsigned int inL_( unsigned int port, size_t profile_reg = LoopProfile::PORT_OTHER ) {
+		++loop_profile.port_reads[profile_reg];
+		return port_io->InL( port );
+	}
+	void outB_( unsigned int val, unsigned int port, size_t profile_reg = LoopProfile::PORT_OTHER ) {
+		++loop_profile.port_writes[profile_reg];
+		port_io->OutB( val, port );
+	}
+	void outL_( unsigned int val, unsigned int port, size_t profile_reg = LoopProfile::PORT_OTHER ) {
+		++loop_profile.port_writes[profile_reg];
+		port_io->OutL( val, port );
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// I/O port of a shadowed register
+	unsigned int shadowPort_( size_t reg ) const {
+		switch ( reg ) {
+		case SHADOW_GP_LVL:		return io_lpc_gpiobase_ + GP_LVL;
+		case SHADOW_GP_LVL2:	return io_lpc_gpiobase_ + GP_LVL2;
+		case SHADOW_GPO_BLINK:	return io_lpc_gpiobase_ + GPO_BLINK;
+		default:				return io_sch5127_regs_ + REG_GP1 + ( reg - SHADOW_GP1 );
+		}
 	}
 	
 	/////////////////////////////////////////////////////////////////////////
-	/// set/clear bit state
-	void doBits_( unsigned int bits, unsigned int port, bool state ) {
-		const unsigned int val = inl( port );
-		const unsigned int new_val = ( state )
-			?	val | bits
-			:	val & ~bits
+	/// set/clear bits in a pending register and write it unless batching
+	void doBits_( size_t reg, unsigned int bits, bool state ) {
+		pending_[reg] = ( state )
+			?	pending_[reg] | bits
+			:	pending_[reg] & ~bits
 		;
-		if ( val != new_val ) outl( new_val, port );
+		markDirty_( reg );
+		if ( !batching_ && dirty_ ) flushRegs_( );
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// blink bits of a level register, in hardware where the ICH9 can
+	///
+	/// GPO_BLINK only covers GPIOs [31:0]. Anything else (GP_LVL2 and the
+	/// SCH5127 GP registers) is toggled by BlinkTick() instead.
+	void setBlinkBits_( size_t reg, unsigned int bits, bool state ) {
+		if ( SHADOW_GP_LVL == reg ) {
+			doBits_( SHADOW_GPO_BLINK, bits, state );
+			return;
+		}
+		
+		soft_blink_[reg] = ( state )
+			?	soft_blink_[reg] | bits
+			:	soft_blink_[reg] & ~bits
+		;
+		markDirty_( reg );
+		if ( !batching_ && dirty_ ) flushRegs_( );
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// mark a register for writing if an LED change left it different from
+	/// the hardware, otherwise count the change as a write saved
+	///
+	/// This is the only place saved writes are counted: a register changed
+	/// and changed back within a batch is counted here by the change back,
+	/// and flushRegs_ just passes over it.
+	void markDirty_( size_t reg ) {
+		if ( output_(reg) != shadow_[reg] ) {
+			dirty_ |= 1U << reg;
+		} else {
+			++loop_profile.led_writes_skipped;
+		}
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// value a register should hold: pending levels with software blinking applied
+	unsigned int output_( size_t reg ) const {
+		return ( pending_[reg] & ~soft_blink_[reg] ) | ( ( blink_phase_ ) ? soft_blink_[reg] : 0 );
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// write every register whose pending value differs from the hardware
+	void flushRegs_( ) {
+		while ( dirty_ ) {
+			const size_t reg = __builtin_ctz( dirty_ );
+			dirty_ &= dirty_ - 1;
+			
+			const unsigned int val = output_( reg );
+			if ( val == shadow_[reg] ) continue; // changed back
+			if ( reg < SHADOW_GP1 ) {
+				outL_( val, shadowPort_(reg), reg );
+			} else {
+				outB_( val, shadowPort_(reg), reg );
+			}
+			shadow_[reg] = val;
+		}
 	}
 	
 	/////////////////////////////////////////////////////////////////////////
 	/// set/clear appropriate GPIO level via io_lpc_gpiobase_
 	void setGpLpcLvl_( int bit, bool state ) {
 		doBits_(
-			(1 << (bit % 32)),
-			io_lpc_gpiobase_ + ((bit < 32) ? GP_LVL : GP_LVL2),
+			( bit < 32 ) ? SHADOW_GP_LVL : SHADOW_GP_LVL2,
+			(1U << (bit % 32)),
 			state
 		);
 	}
 	
+	/////////////////////////////////////////////////////////////////////////
+	/// enable/disable hardware blinking of GPIOs [31:0]
+	void setGpLpcBlink_( unsigned int bits, bool state ) {
+		doBits_( SHADOW_GPO_BLINK, bits, state );
+	}
+	
 	/////////////////////////////////////////////////////////////////////////
 	/// set/clear appropriate GPIO level via io_sch5127_regs_ runtime regs
+	///
+	/// Bits are encoded as 0xRB: bit B (0 - 15) counted from GP register R
+	/// (1 - 6). Bits 8 - 15 live in the following register.
 	void setGpRegsLvl_( int bit, bool state ) {
-		const int reg = ((bit >> 4) & 0xF) - 1;
-		assert( reg >= 0 );
+		const int reg = ((bit >> 4) & 0xF) - 1 + ((bit >> 3) & 0x1);
+		assert( reg >= 0 && reg < GP_REGS_CNT );
 		
 		doBits_(
-			(1 << (bit & 0xF)),
-			io_sch5127_regs_ + REG_GP1 + reg,
+			SHADOW_GP1 + reg,
+			(1U << (bit & 0x7)),
 			state
 		);
 	}
@@ -295,32 +492,42 @@ protected:
 		{
 			const unsigned int gpio_use_sel  = io_lpc_gpiobase_ + GPIO_USE_SEL;
 			const unsigned int gpio_use_sel2 = io_lpc_gpiobase_ + GPIO_USE_SEL2;
-			if ( ioperm(gpio_use_sel,  4, 1) ) throw ErrnoException("ioperm");
-			if ( ioperm(gpio_use_sel2, 4, 1) ) throw ErrnoException("ioperm");
+			if ( port_io->Perm(gpio_use_sel,  4, 1) ) throw ErrnoException("ioperm");
+			if ( port_io->Perm(gpio_use_sel2, 4, 1) ) throw ErrnoException("ioperm");
 			
-			outl( inl(gpio_use_sel)  | bits1, gpio_use_sel  );
-			outl( inl(gpio_use_sel2) | bits2, gpio_use_sel2 );
+			outL_( inL_(gpio_use_sel)  | bits1, gpio_use_sel  );
+			outL_( inL_(gpio_use_sel2) | bits2, gpio_use_sel2 );
 			
-			ioperm( gpio_use_sel, 4, 0 );
-			ioperm( gpio_use_sel2, 4, 0 );
+			port_io->Perm( gpio_use_sel, 4, 0 );
+			port_io->Perm( gpio_use_sel2, 4, 0 );
 		}
 		// Input/Output select (0 = Output, 1 = Input)
 		{
 			const unsigned int gp_io_sel  = io_lpc_gpiobase_ + GP_IO_SEL;
 			const unsigned int gp_io_sel2 = io_lpc_gpiobase_ + GP_IO_SEL2;
-			if ( ioperm(gp_io_sel,  4, 1) ) throw ErrnoException("ioperm");
-			if ( ioperm(gp_io_sel2, 4, 1) ) throw ErrnoException("ioperm");
+			if ( port_io->Perm(gp_io_sel,  4, 1) ) throw ErrnoException("ioperm");
+			if ( port_io->Perm(gp_io_sel2, 4, 1) ) throw ErrnoException("ioperm");
 			
-			outl( inl(gp_io_sel)  & ~bits1, gp_io_sel  );
-			outl( inl(gp_io_sel2) & ~bits2, gp_io_sel2 );
+			outL_( inL_(gp_io_sel)  & ~bits1, gp_io_sel  );
+			outL_( inL_(gp_io_sel2) & ~bits2, gp_io_sel2 );
 			
-			ioperm( gp_io_sel, 4, 0 );
-			ioperm( gp_io_sel2, 4, 0 );
+			port_io->Perm( gp_io_sel, 4, 0 );
+			port_io->Perm( gp_io_sel2, 4, 0 );
 		}
 	}
 	
 	unsigned int io_lpc_gpiobase_;	///< I/O offset to LPC GPIO on the IHR9
 	unsigned int io_sch5127_regs_;	///< I/O offset to SCH5127 runtime registers
+	
+	unsigned int shadow_[SHADOW_CNT];	///< what the shadowed registers currently hold
+	unsigned int pending_[SHADOW_CNT];	///< what we want them to hold
+	unsigned int soft_blink_[SHADOW_CNT];	///< bits we blink in software
+	unsigned int dirty_;				///< registers with pending changes (bit per register)
+	bool batching_;						///< collecting changes for a single write per register?
+	bool blink_phase_;					///< software blinking bits currently set?
+	
+	// LoopProfile counts port accesses by shadow register
+	typedef char profile_regs_check_[ ( (int)SHADOW_CNT == (int)LoopProfile::PORT_OTHER ) ? 1 : -1 ];
 };
 
 #endif // INCLUDED_LED_CONTROL_SCH5127_BASE
@@ -0,0 +1,242 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file light_pattern.cpp
+///
+/// Light show patterns compiled to bytecode
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+//- includes
+#include "light_pattern.h"
+#include "errno_exception.h"
+#include <algorithm>
+#include <assert.h>
+#include <fstream>
+#include <sstream>
+#include <stdlib.h>
+
+/////////////////////////////////////////////////////////////////////////////
+/// complain about a line of a pattern
+static void fail( int line_no, const std::string& msg ) {
+	std::ostringstream str;
+	str << "pattern line " << line_no << ": " << msg;
+	throw std::runtime_error( str.str() );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// read a number from a statement, making sure it's within range
+static unsigned int read_arg( std::istream& words, int line_no, const char* what, unsigned int min_val, unsigned int max_val ) {
+	long val = 0;
+	if ( !( words >> val ) || val < (long)min_val || val > (long)max_val ) {
+		std::ostringstream str;
+		str << "expected " << what << " (" << min_val << " to " << max_val << ")";
+		fail( line_no, str.str() );
+	}
+	return val;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// constructor
+LightPattern::LightPattern( )
+	:	pc_( 0 )
+{
+	std::fill( counters_, counters_ + MAX_DEPTH, 0 );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// compile a pattern, throwing std::runtime_error if it's invalid
+void LightPattern::Compile( const std::string& text ) {
+	code_.clear( );
+	frames_.clear( );
+	
+	std::vector< size_t > loops;	// first instruction of each open loop
+	unsigned int step_ms = 200;
+	bool waits = false;
+	
+	std::istringstream in( text );
+	std::string line;
+	for ( int line_no = 1; std::getline( in, line ); ++line_no ) {
+		line.erase( std::min( line.find( '#' ), line.size() ) );
+		
+		std::istringstream words( line );
+		std::string cmd;
+		if ( !( words >> cmd ) ) continue;
+		
+		if ( "step" == cmd ) {
+			step_ms = read_arg( words, line_no, "milliseconds", 1, ARG_MASK );
+		} else if ( "frame" == cmd ) {
+			std::string bays;
+			words >> bays;
+			if ( bays.empty() || bays.size() > LedFrame::MAX_BAYS ) fail( line_no, "expected a colour per bay" );
+			
+			Frame f;
+			f.random = 0;
+			for ( size_t i = 0; i < bays.size(); ++i ) {
+				switch ( bays[i] ) {
+				case '.': f.frame.SetBay( i, 0 ); break;
+				case 'b': f.frame.SetBay( i, LED_BLUE ); break;
+				case 'r': f.frame.SetBay( i, LED_RED ); break;
+				case 'p': f.frame.SetBay( i, LED_BLUE | LED_RED ); break;
+				case '?': f.frame.SetBay( i, 0 ); f.random |= 1U << i; break;
+				default: fail( line_no, std::string( "unknown colour '" ) + bays[i] + "'" );
+				}
+			}
+			
+			// optional duration
+			unsigned int ms = step_ms;
+			if ( !( words >> std::ws ).eof() ) ms = read_arg( words, line_no, "milliseconds", 0, ARG_MASK );
+			
+			if ( frames_.size() > ARG_MASK ) fail( line_no, "too many frames" );
+			emit_( OP_FRAME, frames_.size() );
+			frames_.push_back( f );
+			if ( ms ) {
+				emit_( OP_WAIT, ms );
+				waits = true;
+			}
+		} else if ( "wait" == cmd ) {
+			emit_( OP_WAIT, read_arg( words, line_no, "milliseconds", 1, ARG_MASK ) );
+			waits = true;
+		} else if ( "bright" == cmd ) {
+			emit_( OP_BRIGHT, read_arg( words, line_no, "brightness", 0, 9 ) );
+		} else if ( "ramp" == cmd ) {
+			const int from = read_arg( words, line_no, "brightness", 0, 9 );
+			const int to   = read_arg( words, line_no, "brightness", 0, 9 );
+			const unsigned int ms = read_arg( words, line_no, "milliseconds", 1, ARG_MASK );
+			for ( int level = from; ; level += ( from < to ) ? 1 : -1 ) {
+				emit_( OP_BRIGHT, level );
+				emit_( OP_WAIT, ms );
+				if ( level == to ) break;
+			}
+			waits = true;
+		} else if ( "loop" == cmd ) {
+			if ( loops.size() >= MAX_DEPTH ) fail( line_no, "loops nested too deeply" );
+			emit_( OP_LOOP, loops.size() << 16 | read_arg( words, line_no, "count", 1, 0xFFFF ) );
+			loops.push_back( code_.size() );
+		} else if ( "end" == cmd ) {
+			if ( loops.empty() ) fail( line_no, "end without loop" );
+			const size_t start = loops.back();
+			loops.pop_back();
+			emit_( OP_NEXT, loops.size() << 16 | start );
+		} else {
+			fail( line_no, "unknown statement '" + cmd + "'" );
+		}
+		
+		std::string extra;
+		if ( words >> extra ) fail( line_no, "unexpected '" + extra + "'" );
+		if ( code_.size() > 0xFFFF ) fail( line_no, "pattern too long" );
+	}
+	
+	if ( !loops.empty() ) throw std::runtime_error( "pattern: loop without end" );
+	if ( !waits ) throw std::runtime_error( "pattern: never waits" );
+	
+	// and round we go again
+	emit_( OP_JUMP, 0 );
+	Reset( );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// compile a pattern from a file
+void LightPattern::Load( const char* path ) {
+	std::ifstream file( path );
+	if ( !file ) throw ErrnoException( std::string( "open(" ) + path + ")" );
+	
+	std::ostringstream text;
+	text << file.rdbuf();
+	Compile( text.str() );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// text of a built-in light show
+///
+/// 1 is holiday lights, then 4 shows (descending and ascending chasers,
+/// knight rider, pulsing) in blue, red and purple.
+std::string LightPattern::BuiltIn( int light_show ) {
+	if ( light_show <= 1 ) return "frame ????\n";
+	
+	static const char* const SHOWS[] = {
+		"frame ...C\nframe ..C.\nframe .C..\nframe C...\n",
+		"frame C...\nframe .C..\nframe ..C.\nframe ...C\n",
+		"frame C...\nframe .C..\nframe ..C.\nframe ...C\nframe ..C.\nframe .C..\n",
+		"frame CCCC 0\nramp 1 9 200\nramp 8 2 200\n",
+	};
+	static const char COLOURS[] = { 'b', 'r', 'p' };
+	
+	const size_t colour = (light_show - 2) / 4;
+	std::string text = SHOWS[ (light_show - 2) % 4 ];
+	std::replace( text.begin(), text.end(), 'C', ( colour < sizeof(COLOURS) ) ? COLOURS[colour] : 'b' );
+	return text;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// start again from the beginning
+void LightPattern::Reset( ) {
+	pc_ = 0;
+	std::fill( counters_, counters_ + MAX_DEPTH, 0 );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// run until the next wait
+int LightPattern::Run( LedFrame& frame, int& brightness ) {
+	assert( !code_.empty() );
+	
+	frame = LedFrame( );
+	brightness = -1;
+	while ( true ) {
+		const unsigned int insn = code_[ pc_++ ];
+		const unsigned int arg = insn & ARG_MASK;
+		
+		switch ( insn >> OP_SHIFT ) {
+		case OP_FRAME: {
+			const Frame& f = frames_[arg];
+			frame = f.frame;
+			for ( unsigned int bits = f.random; bits; bits &= bits - 1 ) {
+				frame.bay[ __builtin_ctz( bits ) ] = rand() % 4; // off, blue, red or both
+			}
+			break;
+		}
+		case OP_WAIT:
+			return arg;
+		case OP_BRIGHT:
+			brightness = arg;
+			break;
+		case OP_LOOP:
+			counters_[ arg >> 16 ] = arg & 0xFFFF;
+			break;
+		case OP_NEXT:
+			if ( --counters_[ arg >> 16 ] ) pc_ = arg & 0xFFFF;
+			break;
+		case OP_JUMP:
+			pc_ = arg;
+			break;
+		}
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// add an instruction
+void LightPattern::emit_( unsigned int op, unsigned int arg ) {
+	assert( arg <= ARG_MASK );
+	code_.push_back( op << OP_SHIFT | arg );
+}
@@ -0,0 +1,116 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file light_pattern.h
+///
+/// Light show patterns compiled to bytecode
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_LIGHT_PATTERN
+#define INCLUDED_LIGHT_PATTERN
+
+//- includes
+#include "led_control_base.h"
+#include <string>
+#include <vector>
+
+/////////////////////////////////////////////////////////////////////////////
+/// light show pattern, compiled to bytecode
+///
+/// Patterns are text, one statement per line ('#' starts a comment):
+///
+///   step MS             default time each frame is shown for (200)
+///   frame CCCC [MS]     show a frame, one character per bay:
+///                         . off, b blue, r red, p purple (both), ? random
+///   wait MS             keep showing the current frame
+///   bright N            set the brightness (0 to 9)
+///   ramp FROM TO MS     step the brightness from FROM to TO, MS per level
+///   loop N ... end      repeat the statements in between N times
+///
+/// The whole pattern repeats forever. Frames are turned into LedFrames and
+/// ramps and durations are resolved when the pattern is compiled, so Run()
+/// only walks a flat instruction array.
+///
+/// e.g. a sweep while a disk rebuilds:
+///
+///   step 150
+///   loop 2
+///     frame r...
+///     frame pr..
+///     frame .pr.
+///     frame ..pr
+///     frame ...p
+///   end
+///   frame .... 600
+class LightPattern {
+public:
+	LightPattern( );
+	
+	/// compile a pattern, throwing std::runtime_error if it's invalid
+	void Compile( const std::string& text );
+	
+	/// compile a pattern from a file
+	void Load( const char* path );
+	
+	/// text of a built-in light show (see --light-show)
+	static std::string BuiltIn( int light_show );
+	
+	/// start again from the beginning
+	void Reset( );
+	
+	/// run until the next wait
+	/// @param frame Receives the frame to show (no bays if it hasn't changed)
+	/// @param brightness Receives the brightness to set (-1 if unchanged)
+	/// @return How long to wait before calling again (ms)
+	int Run( LedFrame& frame, int& brightness );
+	
+private:
+	enum {
+		OP_FRAME	= 0,	///< show frames_[ARG]
+		OP_WAIT,			///< wait ARG ms
+		OP_BRIGHT,			///< set brightness to ARG
+		OP_LOOP,			///< counters_[ARG >> 16] = ARG & 0xFFFF
+		OP_NEXT,			///< jump to ARG & 0xFFFF while --counters_[ARG >> 16]
+		OP_JUMP,			///< jump to ARG
+		
+		OP_SHIFT	= 24,	///< opcode lives in the top byte
+		ARG_MASK	= ( 1 << OP_SHIFT ) - 1,
+		MAX_DEPTH	= 8,	///< deepest loop nesting
+	};
+	
+	/// a frame with the bays picking a random colour each time
+	struct Frame {
+		LedFrame		frame;
+		unsigned int	random;	///< random bays (bit per bay)
+	};
+	
+	void emit_( unsigned int op, unsigned int arg );
+	
+	std::vector< unsigned int >	code_;		///< instructions (op << OP_SHIFT | arg)
+	std::vector< Frame >		frames_;	///< frames referenced by OP_FRAME
+	size_t						pc_;		///< next instruction
+	unsigned int				counters_[MAX_DEPTH];	///< loop counters
+};
+
+#endif // INCLUDED_LIGHT_PATTERN
@@ -0,0 +1,101 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file loop_profile.cpp
+///
+/// Always-on profiling counters for the LED loop
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+//- includes
+#include "loop_profile.h"
+#include <iomanip>
+#include <iostream>
+#include <time.h>
+
+//- globals
+LoopProfile loop_profile;
+
+/////////////////////////////////////////////////////////////////////////////
+/// monotonic clock in microseconds
+static unsigned long long monotonic_us( ) {
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// print the non-empty buckets of a histogram
+static void dump_histogram( const char* name, const unsigned long long* histogram ) {
+	unsigned long long total = 0;
+	for ( size_t i = 0; i < LoopProfile::BUCKETS; ++i ) total += histogram[i];
+	if ( !total ) return;
+	
+	std::cout << "  " << name << " over " << total << ":\n";
+	for ( size_t i = 0; i < LoopProfile::BUCKETS; ++i ) {
+		if ( !histogram[i] ) continue;
+		
+		const unsigned long long lo = ( i ) ? 1ULL << ( i - 1 ) : 0;
+		const unsigned long long hi = ( i ) ? ( 1ULL << i ) - 1 : 0;
+		std::cout << "    " << std::setw( 10 ) << lo << " - " << std::setw( 10 ) << hi << "us: "
+			<< histogram[i] << " (" << std::fixed << std::setprecision( 2 ) << 100.0 * histogram[i] / total << "%)\n";
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// zero everything and start counting from now
+void LoopProfile::Reset( ) {
+	since_us = monotonic_us( );
+	ticks = udev_events = sysfs_reads = led_writes_skipped = 0;
+	std::fill( port_reads,      port_reads      + PORT_REGS, 0 );
+	std::fill( port_writes,     port_writes     + PORT_REGS, 0 );
+	std::fill( tick_us,         tick_us         + BUCKETS,   0 );
+	std::fill( event_to_led_us, event_to_led_us + BUCKETS,   0 );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// print everything counted so far
+void LoopProfile::Dump( ) const {
+	// named in the order LedControlSCH5127Base shadows them
+	static const char* const PORT_NAMES[ PORT_REGS ] = {
+		"GP_LVL", "GP_LVL2", "GPO_BLINK", "GP1", "GP2", "GP3", "GP4", "GP5", "GP6", "other",
+	};
+	
+	const std::ios::fmtflags flags = std::cout.flags( );
+	const std::streamsize precision = std::cout.precision( );
+	
+	std::cout << "profile over " << std::fixed << std::setprecision( 3 ) << ( monotonic_us( ) - since_us ) / 1000000.0 << "s:\n"
+		<< "  ticks " << ticks << ", udev events " << udev_events << ", sysfs reads " << sysfs_reads
+		<< ", LED writes skipped " << led_writes_skipped << '\n';
+	for ( size_t i = 0; i < PORT_REGS; ++i ) {
+		if ( !port_reads[i] && !port_writes[i] ) continue;
+		std::cout << "  " << std::setw( 9 ) << PORT_NAMES[i] << ": " << port_reads[i] << " in, " << port_writes[i] << " out\n";
+	}
+	dump_histogram( "tick duration", tick_us );
+	dump_histogram( "event to LED latency", event_to_led_us );
+	std::cout << std::flush;
+	
+	std::cout.flags( flags );
+	std::cout.precision( precision );
+}
@@ -0,0 +1,76 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file loop_profile.h
+///
+/// Always-on profiling counters for the LED loop
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_LOOP_PROFILE
+#define INCLUDED_LOOP_PROFILE
+
+//- includes
+#include <algorithm>
+
+/////////////////////////////////////////////////////////////////////////////
+/// counters of where the daemon's time goes
+///
+/// Everything is plain counters in fixed size arrays, bumped inline where
+/// the work happens, so they stay enabled in normal runs. The event loop
+/// dumps them on SIGUSR1 and resets them on SIGUSR2.
+struct LoopProfile {
+	enum {
+		BUCKETS		= 24,	///< log2 duration buckets (0us, 1us, 2-3us, ... 4s and up)
+		PORT_REGS	= 10,	///< shadowed SCH5127/ICH9 LED registers, then everything else
+		PORT_OTHER	= PORT_REGS - 1,
+	};
+	
+	LoopProfile( ) { Reset( ); }
+	
+	/// zero everything and start counting from now
+	void Reset( );
+	
+	/// print everything counted so far
+	void Dump( ) const;
+	
+	/// add a duration to a histogram
+	static void Record( unsigned long long* histogram, unsigned long long us ) {
+		++histogram[ ( us ) ? std::min( 64 - __builtin_clzll( us ), (int)BUCKETS - 1 ) : 0 ];
+	}
+	
+	unsigned long long	since_us;					///< when counting started
+	unsigned long long	ticks;						///< activity samples taken
+	unsigned long long	udev_events;				///< udev notifications handled
+	unsigned long long	sysfs_reads;				///< disk stat files read
+	unsigned long long	port_reads[PORT_REGS];		///< inb/inl by register
+	unsigned long long	port_writes[PORT_REGS];		///< outb/outl by register
+	unsigned long long	led_writes_skipped;			///< LED changes that left the registers as they were
+	unsigned long long	tick_us[BUCKETS];			///< time taken sampling activity
+	unsigned long long	event_to_led_us[BUCKETS];	///< from an event waking us to the LEDs it changed being written
+};
+
+/// counters for this process
+extern LoopProfile loop_profile;
+
+#endif // INCLUDED_LOOP_PROFILE
@@ -44,16 +44,29 @@
 
 //- includes
 #include "errno_exception.h"
+#include "control_server.h"
+#include "event_loop.h"
 #include "device_monitor.h"
+#include "hw_cache.h"
+#include "led_compositor.h"
+#include "light_pattern.h"
+#include "metrics_server.h"
+#include "package_counter.h"
+#include "realtime.h"
+#include "simulated_chipset.h"
 #include "led_acerh340.h"
 #include "led_acer_altos_m2.h"
 #include "led_acerh341.h"
 #include "led_hpex485.h"
+#include "tick_timer.h"
+#include "udev_attribute.h"
 #include "update_monitor.h"
 #include <iomanip>
 #include <iostream>
 #include <string>
+#include <assert.h>
 #include <stdio.h>
+#include <time.h>
 
 #include <getopt.h>
 #include <libudev.h>
@@ -61,6 +74,7 @@
 #include <signal.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/resource.h>
 #include <sys/select.h>
 
 using std::cout;
@@ -69,6 +83,17 @@ using std::cout;
 int debug = 0;		///< show debug messages
 int verbose = 0;	///< how much debugging we spew out
 bool activity = 0;	///< do we make the lights blink?
+int activity_interval = 250;	///< how often we sample disk activity (ms)
+int activity_idle_interval = 2000;	///< slowest we sample while all disks are idle (ms)
+double activity_backoff = 1.5;	///< how quickly the sampling interval grows while idle
+bool activity_intensity = false;	///< dim activity lights by how busy each disk is
+bool update_native = false;	///< count updates natively rather than with apt-check
+
+/// where we remember what hardware probing found
+static const char HW_CACHE_PATH[] = "/var/run/mediasmartserverd.hw";
+
+/// control socket of a running daemon
+static const char CONTROL_PATH[] = "/var/run/mediasmartserverd.sock";
 
 
 
@@ -97,78 +122,155 @@ void drop_priviledges( ) {
 }
 
 /////////////////////////////////////////////////////////////////////////////
-// get attribute from udev device specified by subsytem an device name
-const char *GetUdevDeviceAttribute(const char *subsystem, const char *sysname, const char *sysattr) {
-	struct udev *udev;
-	struct udev_device *device;
-	std::string value;
+/// monotonic clock in microseconds
+static unsigned long long monotonic_us( ) {
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return (unsigned long long)now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
 
-	udev = udev_new();
-	if (!udev) throw ErrnoException("udev_new");
+static unsigned long long startup_us = 0;	///< when we started
+static bool hw_cached = false;				///< LED hardware came from the cache rather than probing
 
-	device = udev_device_new_from_subsystem_sysname(udev, subsystem, sysname);
-	value = udev_device_get_sysattr_value(device, sysattr);
-	value.erase(value.begin(), std::find_if(value.begin(), value.end(), std::not1(std::ptr_fun<int, int>(std::isspace))));
-	value.erase(std::find_if(value.rbegin(), value.rend(), std::not1(std::ptr_fun<int, int>(std::isspace))).base(), value.end());
-	//free
-	udev_device_unref(device);
-	udev_unref(udev);
-	
-	return strdup(value.c_str());
+/////////////////////////////////////////////////////////////////////////////
+/// note an LED write, reporting time since startup for the first (--debug)
+static void led_written( ) {
+	static bool reported = false;
+	if ( reported || !debug ) return;
+	reported = true;
+	
+	cout << "Startup: first LED write after " << ( monotonic_us() - startup_us ) << " us ("
+		<< ( ( hw_cached ) ? "cached" : "probed" ) << " hardware)\n";
 }
 
 /////////////////////////////////////////////////////////////////////////////
-/// attempt to get an LED control interface
-LedControlPtr get_led_interface( ) {
-	LedControlPtr control;
-	
-	const char *systemVendor = GetUdevDeviceAttribute("dmi", "id", "sys_vendor");
-	const char *productName = GetUdevDeviceAttribute("dmi", "id", "product_name");
-	
-	if(verbose > 0) cout << "--- SystemVendor: \"" << systemVendor
-		<< "\" - ProductName: \"" << productName << "\" ---\n";
-	
-	if (strcmp(systemVendor, "Acer") == 0) {
+/// create an LED control interface
+template < typename T >
+static LedControlBase* new_led_control( ) { return new T; }
+
+/// LED control interfaces by name (as kept in the hardware cache)
+static const struct {
+	const char*		name;
+	LedControlBase*	(*create)( );
+	unsigned int	did_vid;	///< LPC bridge device and vendor id (for --simulate)
+} LED_CONTROLS[] = {
+	{ "acer-h340",		&new_led_control< LedAcerH340 >,    LedAcerH340Board::PCI_DID_VID    },
+	{ "acer-h341",		&new_led_control< LedAcerH341 >,    LedAcerH341Board::PCI_DID_VID    },
+	{ "acer-altos-m2",	&new_led_control< LedAcerAltosM2 >, LedAcerAltosM2Board::PCI_DID_VID },
+	{ "hp-ex48x",		&new_led_control< LedHpEx48X >,     LedHpEx48XBoard::PCI_DID_VID     },
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// create an LED control interface by name
+static LedControlPtr create_led_control( const char* name ) {
+	for ( size_t i = 0; i < sizeof(LED_CONTROLS) / sizeof(LED_CONTROLS[0]); ++i ) {
+		if ( 0 == strcmp( name, LED_CONTROLS[i].name ) ) return LedControlPtr( LED_CONTROLS[i].create( ) );
+	}
+	return LedControlPtr( );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// simulate the chipset of an LED control interface, rather than the hardware
+/// @return false if there's no such interface
+static bool simulate_chipset( const char* name, std::tr1::shared_ptr< SimulatedChipset >& chipset ) {
+	for ( size_t i = 0; i < sizeof(LED_CONTROLS) / sizeof(LED_CONTROLS[0]); ++i ) {
+		if ( 0 != strcmp( name, LED_CONTROLS[i].name ) ) continue;
+		chipset.reset( new SimulatedChipset( LED_CONTROLS[i].did_vid ) );
+		port_io = chipset.get( );
+		return true;
+	}
+	return false;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// work out which LED control interface this system should have
+static const char* led_control_name( const std::string& systemVendor, const std::string& productName ) {
+	if (systemVendor == "Acer") {
 		if(verbose > 0) cout << "Recognized SystemVendor: \"Acer\"\n";
-		if (strcmp(productName, "Aspire easyStore H340") == 0) {
+		if (productName == "Aspire easyStore H340") {
 			// H340
 			if(verbose > 0) cout << "Recognized ProductName: \"Aspire easyStore H340\"\n";
-			control.reset( new LedAcerH340 );
-			if ( control->Init( ) ) return control;
+			return "acer-h340";
 		}
-		if (strcmp(productName, "Altos easyStore M2") == 0) {
+		if (productName == "Altos easyStore M2") {
 			// Altos M2
 			if(verbose > 0) cout << "Recognized ProductName: \"Altos easyStore M2\"\n";
-			control.reset( new LedAcerAltosM2 );
-			if ( control->Init( ) ) return control;
+			return "acer-altos-m2";
 		}
-		if (strcmp(productName, "Aspire easyStore H341") == 0 || strcmp(productName, "Aspire easyStore H342") == 0) {
+		if (productName == "Aspire easyStore H341" || productName == "Aspire easyStore H342") {
 			// H341 or H342
 			if(verbose > 0) cout << "Recognized ProductName: \"" << productName << "\"\n";
-			control.reset( new LedAcerH341 );
-			if ( control->Init( ) ) return control;
+			return "acer-h341";
 		}
 	}
-	else if (strcmp(systemVendor, "LENOVO") == 0) {
+	else if (systemVendor == "LENOVO") {
 		if(verbose > 0) cout << "Recognized SystemVendor: \"Lenovo\"\n";
-		if (strcmp(productName, "IdeaCentre D400 10023") == 0) {
+		if (productName == "IdeaCentre D400 10023") {
 			// IdeaCentre D400
 			if(verbose > 0) cout << "Recognized ProductName: \"IdeaCentre D400 10023\"\n";
-			control.reset( new LedAcerH340 ); //Compatiple with H340.
-			if ( control->Init( ) ) return control;
+			return "acer-h340"; //Compatiple with H340.
 		}
 	}
 	else { // HP // If you have the system vendor and product name please add.
 		// HP48X
 		if(verbose > 0) cout << "Unrecognized SystemVendor: \"" 
 			<< systemVendor << "\"\nAssuming HP\n";
-		control.reset( new LedHpEx48X );
-		if ( control->Init( ) ) return control;
+		return "hp-ex48x";
 	}
-	//free
-	free((char*)systemVendor);
-	free((char*)productName);
-	return LedControlPtr( );
+	return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// attempt to get an LED control interface
+/// @param rescan Probe the hardware even if we have it cached
+/// @param simulated Name of the interface whose chipset is being simulated (if any)
+LedControlPtr get_led_interface( bool rescan, const char* simulated ) {
+	// simulated hardware is always probed (and never cached)
+	if ( simulated ) {
+		LedControlPtr control = create_led_control( simulated );
+		if ( !control || !control->Init( ) ) return LedControlPtr( );
+		return control;
+	}
+	
+	std::string systemVendor, productName;
+	{
+		std::tr1::shared_ptr< udev > udev( udev_new( ), &udev_unref );
+		if ( !udev ) throw ErrnoException( "udev_new" );
+		
+		systemVendor = GetUdevDeviceAttribute(udev.get(), "dmi", "id", "sys_vendor");
+		productName  = GetUdevDeviceAttribute(udev.get(), "dmi", "id", "product_name");
+	}
+	
+	if(verbose > 0) cout << "--- SystemVendor: \"" << systemVendor
+		<< "\" - ProductName: \"" << productName << "\" ---\n";
+	
+	const char* name = led_control_name( systemVendor, productName );
+	if ( !name ) return LedControlPtr( );
+	
+	LedControlPtr control = create_led_control( name );
+	assert( control );
+	
+	// already probed since boot?
+	const std::string cache_key = HwCache::Key( systemVendor, productName );
+	HwCache cache;
+	if ( !rescan && cache.Load( HW_CACHE_PATH, cache_key ) && cache.board == name ) {
+		if ( control->InitCached( cache.hw ) ) {
+			if ( debug ) cout << "Using cached hardware: " << name << std::hex
+				<< " gpiobase 0x" << cache.hw.gpiobase << " sch5127 0x" << cache.hw.sch5127_regs << std::dec << '\n';
+			hw_cached = true;
+			return control;
+		}
+		control = create_led_control( name );
+	}
+	
+	if ( !control->Init( ) ) return LedControlPtr( );
+	
+	// remember what we found for next time
+	cache.board = name;
+	cache.hw = control->HwInfo( );
+	if ( !cache.Save( HW_CACHE_PATH, cache_key ) && debug ) cout << "Failed to write " << HW_CACHE_PATH << '\n';
+	
+	return control;
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -178,9 +280,35 @@ int show_help( ) {
 		<< "     --brightness=X    Set LED brightness (1 to 10)\n"
 		<< " -D, --daemon          Detach and run in the background\n"
 		<< " -a, --activity        Use the bay lights as disk activity lights\n"
+		<< "                       (blue for reads, red for writes)\n"
+		<< "     --count-updates[=ROOT]  Print update counts like apt-check and exit\n"
+		<< "                       (ROOT prefixes the dpkg and apt paths; with --debug,\n"
+		<< "                       compares time and memory use against apt-check)\n"
 		<< "     --debug           Print debug messages\n"
+		<< "     --intensity       Like -a, with the brightness of each bay following how\n"
+		<< "                       busy its disk is\n"
+		<< "     --interval=MS     Disk activity sampling interval (default 250)\n"
+		<< "     --locate=N        Blink bay N (0 to 3) to help find it\n"
+		<< "     --metrics=[ADDR:]PORT  Serve per bay disk stats and LED state over HTTP\n"
+		<< "                       for Prometheus (ADDR defaults to 127.0.0.1)\n"
+		<< "     --native-updates  Count updates from the dpkg status and apt lists rather\n"
+		<< "                       than with apt-check (ignores pinning and phased updates)\n"
+		<< "     --pattern=FILE    Run a light show from a pattern file\n"
+		<< "     --idle-interval=MS  Slowest sampling interval while idle (default 2000)\n"
+		<< "     --backoff=X       Interval growth per idle sample (default 1.5)\n"
 		<< "     --help            Print help text\n"
+		<< "     --realtime[=PRIO] Run the LED loop at SCHED_FIFO priority PRIO (default 10)\n"
+		<< "                       with memory locked\n"
+		<< "     --cpu=N           Pin the LED loop to CPU N\n"
+		<< "     --timer-slack=NS  Timer slack for the LED loop (default 1000 with --realtime)\n"
+		<< "     --release         Hand LEDs set by --xmas or --locate back to the daemon\n"
+		<< "     --rescan          Probe the hardware even if it's cached\n"
+		<< "     --simulate[=BOARD]  Drive a simulated chipset rather than the hardware\n"
+		<< "                       (acer-h340 by default, acer-h341, acer-altos-m2 or\n"
+		<< "                       hp-ex48x), without the control socket\n"
 		<< " -u  --update-monitor  Use system LED as update notification light\n"
+		<< "                       (--brightness, --locate, --usb and --xmas on their own\n"
+		<< "                       are passed to a running daemon if there is one)\n"
 		<< " -v, --verbose         verbose (use twice to be more verbose)\n" 
 		<< " -V, --version         Show version number\n" 
 	;
@@ -196,89 +324,135 @@ int show_version( ) {
 }
 
 /////////////////////////////////////////////////////////////////////////////
-/// run a light show
-int run_light_show( const LedControlPtr& leds, int light_show ) {
-	
-	int light_leds = 0;
-	size_t show_mode = 0;
-	if ( 1 == light_show ) {
-		// holiday lights
-		srand( time(0) );
-	} else {
-		show_mode = (light_show - 2) % 4 + 1;
-		switch ( (light_show - 2) / 4 ) {
-		default:
-		case 0: light_leds = LED_BLUE; break;
-		case 1: light_leds = LED_RED;  break;
-		case 2: light_leds = LED_BLUE | LED_RED; break;
-		}
+/// print update counts the way apt-check does
+/// @param root Prefix for the dpkg and apt paths (0 for none)
+int count_updates( const char* root ) {
+	PackageCounter counter( ( root ) ? root : "" );
+	
+	const unsigned long long start_us = monotonic_us( );
+	int updates = 0, security_updates = 0;
+	const bool ok = counter.Count( updates, security_updates );
+	const unsigned long long native_us = monotonic_us( ) - start_us;
+	
+	if ( !ok ) {
+		cout << "Couldn't read the dpkg status or package lists\n";
+		return 1;
+	}
+	cout << updates << ';' << security_updates << '\n';
+	if ( !debug ) return 0;
+	
+	struct rusage usage;
+	getrusage( RUSAGE_SELF, &usage );
+	cout << "native:    " << native_us / 1000.0 << "ms, peak RSS " << usage.ru_maxrss << "kB, "
+		<< counter.ListsRead( ) << " lists\n";
+	
+	// apt-check only knows the real system
+	if ( root ) return 0;
+	
+	const unsigned long long apt_start_us = monotonic_us( );
+	int apt_updates = 0, apt_security_updates = 0;
+	if ( !UpdateMonitor::RunAptCheck( &apt_updates, &apt_security_updates ) ) {
+		cout << "apt-check: unavailable\n";
+		return 0;
 	}
+	const unsigned long long apt_us = monotonic_us( ) - apt_start_us;
 	
+	getrusage( RUSAGE_CHILDREN, &usage );
+	cout << "apt-check: " << apt_us / 1000.0 << "ms, peak RSS " << usage.ru_maxrss << "kB, "
+		<< apt_updates << ';' << apt_security_updates << '\n';
+	return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// pass one-shot settings to a running daemon as a single batch
+/// @return false if there's no daemon to pass them to
+bool forward_to_daemon( int brightness, int locate, int mount_usb, bool xmas, bool release ) {
+	ControlCmd cmds[CTL_MAX_CMDS];
+	size_t cnt = 0;
+	
+	if ( release ) {
+		const ControlCmd cmd = { CTL_RELEASE, 0, 0, 0 };
+		cmds[cnt++] = cmd;
+	}
+	if ( mount_usb >= 0 ) {
+		const ControlCmd cmd = { CTL_USB, !!mount_usb, 0, 0 };
+		cmds[cnt++] = cmd;
+	}
+	if ( brightness >= 0 ) {
+		const ControlCmd cmd = { CTL_BRIGHTNESS, (unsigned char)std::min( brightness, 255 ), 0, 0 };
+		cmds[cnt++] = cmd;
+	}
+	for ( size_t i = 0; i < 4; ++i ) {
+		if ( !xmas && (int)i != locate ) continue;
+		const ControlCmd cmd = {
+			CTL_SET_BAY, (unsigned char)i,
+			(unsigned char)( ( xmas ) ? LED_BLUE | LED_RED : 0 ),
+			(unsigned char)( ( (int)i == locate ) ? LED_BLUE : 0 ),
+		};
+		cmds[cnt++] = cmd;
+	}
+	
+	ControlState state;
+	if ( !control_request( CONTROL_PATH, cmds, cnt, state ) ) return false;
 	
-	size_t state = 0;
+	if ( debug || verbose > 0 ) {
+		cout << "Passed to running daemon, bays now:";
+		for ( size_t i = 0; i < 4; ++i ) cout << ' ' << (int)state.bay[i] << '/' << (int)state.bay_blink[i];
+		cout << '\n';
+	}
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// run a light show
+int run_light_show( const LedCompositorPtr& compositor, LightPattern& pattern ) {
+	// holiday lights
+	srand( time(0) );
+	
+	TickTimer ticker;
+	const int fd_tick = ticker.Fd( );
 	
 	sigset_t sigempty;
 	sigemptyset( &sigempty );
 	while ( true ) {
 		
-		switch ( show_mode ) {
-		case 0: // holiday lights
-		{
-			for ( size_t i = 0; i < 4; ++i ) {
-				switch ( rand() % 4 ) {
-				default:
-				case 0: light_leds = 0; break;
-				case 1: light_leds = LED_BLUE; break;
-				case 2: light_leds = LED_RED;  break;
-				case 3: light_leds = LED_BLUE | LED_RED; break;
-				}
-				
-				leds->Set(  light_leds, i, true );
-				leds->Set( ~light_leds, i, false );
-			}
-			break;
-		}
-		case 1: // descending chasers
-		{
-			for ( size_t i = 0; i < 4; ++i ) leds->Set( light_leds, i, (i == (3 - state)) );
-			if ( ++state >= 4 ) state = 0;
-			break;
-		}
-		case 2: // ascending chasers
-		{
-			for ( size_t i = 0; i < 4; ++i ) leds->Set( light_leds, i, (i == state) );
-			if ( ++state >= 4 ) state = 0;
-			break;
-		}
-		case 3: // knight rider
-		{
-			const size_t sel = ( state < 3 ) ? state : 6 - state;
-			for ( size_t i = 0; i < 4; ++i ) leds->Set( light_leds, i, (i == sel) );
-			if ( ++state >= 6 ) state = 0;
-			break;
-		}
-		case 4: // pulsing
-		{
-			for ( size_t i = 0; i < 4; ++i ) leds->Set( light_leds, i, true );
-			const size_t sel = 1 + ( ( state < 9 ) ? state : 16 - state );
-			leds->SetBrightness( sel );
-			if ( ++state >= 16 ) state = 0;
-			break;
+		LedFrame frame;
+		int brightness = -1;
+		const int wait_ms = pattern.Run( frame, brightness );
+		
+		if ( brightness >= 0 ) compositor->SetBrightness( brightness );
+		if ( frame.bays ) {
+			compositor->Publish( LAYER_OVERRIDE, frame );
+			compositor->Commit( );
 		}
-		default:
-			cout << "Unsupported light show\n";
-			return 1;
+		
+		// each wait carries on from the previous deadline
+		if ( ticker.Running( ) ) {
+			ticker.SetPeriod( wait_ms );
+		} else {
+			ticker.Start( wait_ms );
 		}
 		
 		
-		// wait a bit
-		struct timespec timeout = { 0, 200000000 };
-		int res = pselect( 0, 0, 0, 0, &timeout, &sigempty );
-		if ( res < 0 ) {
-			if ( EINTR != errno ) throw ErrnoException( "select" );
-			cout << "Exiting on signal\n";
-			break; // signalled
-		}
+		// wait for the next frame
+		do {
+			fd_set fds_read;
+			FD_ZERO( &fds_read );
+			FD_SET( fd_tick, &fds_read );
+			
+			int res = pselect( fd_tick + 1, &fds_read, 0, 0, 0, &sigempty );
+			if ( res < 0 ) {
+				if ( EINTR != errno ) throw ErrnoException( "select" );
+				if ( debug || verbose > 0 ) {
+					ticker.Report( "light show" );
+					ticker.ReportHistogram( "light show" );
+				}
+				cout << "Exiting on signal\n";
+				return 0; // signalled
+			}
+		} while ( !ticker.Expired( ) );
+		
+		if ( debug && 0 == ticker.Ticks( ) % 100 ) ticker.Report( "light show" );
 	}
 	
 	return 0;
@@ -288,21 +462,47 @@ int run_light_show( const LedControlPtr& leds, int light_show ) {
 /////////////////////////////////////////////////////////////////////////////
 /// main entry point
 int main( int argc, char* argv[] ) try {
+	startup_us = monotonic_us( );
+	
 	int brightness = -1;
 	int light_show = 0;
+	const char* pattern_file = 0;
+	RealtimeConfig realtime;
+	int locate = -1;
 	int mount_usb = -1;
 	bool run_as_daemon = false;
 	bool xmas = false;
 	bool run_update_monitor = false;
+	bool rescan = false;
+	bool release = false;
+	bool counting_updates = false;
+	const char* count_root = 0;
+	const char* metrics_addr = 0;
+	const char* simulate = 0;
 	
 	// long command line arguments
 	const struct option long_opts[] = {
 		{ "brightness",     required_argument, 0, 'b' },
 		{ "daemon",         no_argument,       0, 'D' },
 		{ "activity",       no_argument,       0, 'a' },
+		{ "count-updates",  optional_argument, 0, 'G' },
+		{ "backoff",        required_argument, 0, 'B' },
 		{ "debug",          no_argument,       0, 'd' },
 		{ "help",           no_argument,       0, 'h' },
+		{ "idle-interval",  required_argument, 0, 'I' },
+		{ "intensity",      no_argument,       0, 'N' },
+		{ "interval",       required_argument, 0, 'i' },
 		{ "light-show",     required_argument, 0, 'S' },
+		{ "locate",         required_argument, 0, 'L' },
+		{ "metrics",        required_argument, 0, 'M' },
+		{ "native-updates", no_argument,       0, 'A' },
+		{ "pattern",        required_argument, 0, 'P' },
+		{ "realtime",       optional_argument, 0, 'T' },
+		{ "cpu",            required_argument, 0, 'C' },
+		{ "timer-slack",    required_argument, 0, 'K' },
+		{ "release",        no_argument,       0, 'E' },
+		{ "rescan",         no_argument,       0, 'R' },
+		{ "simulate",       optional_argument, 0, 'Z' },
 		{ "update-monitor", no_argument,       0, 'u' },
 		{ "usb",            required_argument, 0, 'U' },
 		{ "verbose",        no_argument,       0, 'v' },
@@ -329,8 +529,54 @@ int main( int argc, char* argv[] ) try {
 		case 'a': // run as a daemon (background)
 			activity = true;
 			break;
+		case 'A': // count updates natively
+			update_native = true;
+			break;
+		case 'G': // just count updates
+			counting_updates = true;
+			count_root = optarg;
+			break;
 		case 'h': // help!
 			return show_help( );
+		case 'i': // activity sampling interval
+			if ( optarg ) activity_interval = std::max( 10, atoi( optarg ) );
+			break;
+		case 'M': // serve metrics
+			metrics_addr = optarg;
+			break;
+		case 'N': // per bay activity intensity
+			activity = activity_intensity = true;
+			break;
+		case 'I': // slowest activity sampling interval
+			if ( optarg ) activity_idle_interval = atoi( optarg );
+			break;
+		case 'B': // activity sampling backoff
+			if ( optarg ) activity_backoff = std::max( 1.0, atof( optarg ) );
+			break;
+		case 'L': // blink a bay
+			if ( optarg ) locate = atoi( optarg );
+			break;
+		case 'P': // light show from a pattern file
+			pattern_file = optarg;
+			break;
+		case 'T': // real time scheduling
+			realtime.priority = ( optarg ) ? std::max( 1, atoi( optarg ) ) : 10;
+			break;
+		case 'C': // pin the LED loop to a CPU
+			if ( optarg ) realtime.cpu = atoi( optarg );
+			break;
+		case 'K': // timer slack
+			if ( optarg ) realtime.timer_slack_ns = std::max( 0L, atol( optarg ) );
+			break;
+		case 'E': // release LEDs set over the control socket
+			release = true;
+			break;
+		case 'R': // ignore hardware cache
+			rescan = true;
+			break;
+		case 'Z': // simulated chipset
+			simulate = ( optarg ) ? optarg : "acer-h340";
+			break;
 		case 'S': // light-show
 			if ( optarg ) light_show = atoi( optarg );
 			break;
@@ -357,20 +603,48 @@ int main( int argc, char* argv[] ) try {
 	}
 	
 	
+	if ( counting_updates ) return count_updates( count_root );
+	
+	// compile any light show before touching the hardware
+	LightPattern pattern;
+	if ( pattern_file ) {
+		pattern.Load( pattern_file );
+	} else if ( light_show > 0 ) {
+		pattern.Compile( LightPattern::BuiltIn( light_show ) );
+	}
+	
+	// real time mode wants tight timers unless told otherwise
+	if ( realtime.priority > 0 && realtime.timer_slack_ns < 0 ) realtime.timer_slack_ns = 1000;
+	
+	// never back off to faster than the active rate
+	activity_idle_interval = std::max( activity_interval, activity_idle_interval );
+	
+	// one-shot settings go to the daemon that owns the hardware, if it's running
+	const bool one_shot = ( brightness >= 0 || locate >= 0 || mount_usb >= 0 || xmas || release );
+	const bool monitoring = ( run_as_daemon || activity || run_update_monitor || metrics_addr || pattern_file || light_show > 0 );
+	if ( one_shot && !monitoring && !simulate && forward_to_daemon( brightness, locate, mount_usb, xmas, release ) ) return 0;
+	if ( release ) return 0; // nothing to release without a daemon
+	
 	// register signal handlers
 	init_signals( );
 	
+	// drive a simulated chipset rather than the hardware?
+	std::tr1::shared_ptr< SimulatedChipset > chipset;
+	if ( simulate && !simulate_chipset( simulate, chipset ) ) throw std::runtime_error( std::string( "Unknown board: " ) + simulate );
+	
 	// find led control interface
-	LedControlPtr leds = get_led_interface( );
+	LedControlPtr leds = get_led_interface( rescan, simulate );
 	if ( !leds ) throw std::runtime_error( "Failed to find an LED control interface" );
 	
-	// drop root priviledges
+	// drop root priviledges (keeping what real time mode needs)
+	realtime_raise_limits( realtime );
 	drop_priviledges( );
 	
 	// mount USB?
 	if ( mount_usb >= 0 ) {
 		if ( debug || verbose > 0 ) cout << ( (mount_usb) ? "M" : "Unm" ) << "ounting USB device\n";
 		leds->MountUsb( !!mount_usb );
+		led_written( );
 	}
 	
 	// run as a daemon?
@@ -378,43 +652,75 @@ int main( int argc, char* argv[] ) try {
 	
 	cout << "Found: " << leds->Desc( ) << '\n';
 	
-	// disable annoying blinking guy // changed to disabling completely
-	leds->SetSystemLed( LED_RED, false );
-	leds->SetSystemLed( LED_BLUE, false );
-	
 	//
-	if ( brightness >= 0 ) leds->SetBrightness( brightness );
+	if ( brightness >= 0 ) {
+		leds->SetBrightness( brightness );
+		led_written( );
+	}
+	
+	// everything LED wise goes through here from now on
+	LedCompositorPtr compositor( new LedCompositor( leds ) );
+	
+	// clear out LEDs (anything no layer claims is off)
+	// disable annoying blinking guy // changed to disabling completely
+	LedFrame override_frame;
+	for ( size_t i = 0; i < 4; ++i ) {
+		if ( xmas ) override_frame.SetBay( i, LED_BLUE | LED_RED );
+		if ( (int)i == locate ) override_frame.SetBayBlink( i, LED_BLUE );
+	}
+	compositor->Publish( LAYER_OVERRIDE, override_frame );
+	compositor->Commit( );
+	led_written( );
 	
-	// clear out LEDs
-	leds->Set( LED_BLUE | LED_RED, 0, xmas );
-	leds->Set( LED_BLUE | LED_RED, 1, xmas );
-	leds->Set( LED_BLUE | LED_RED, 2, xmas );
-	leds->Set( LED_BLUE | LED_RED, 3, xmas );
 	if ( xmas ) return 0;
 	
-	if ( light_show > 0 ) return run_light_show( leds, light_show );
+	if ( pattern_file || light_show > 0 ) {
+		realtime_enter( realtime );
+		return run_light_show( compositor, pattern );
+	}
 	
-	// initialise update monitor
-	UpdateMonitor update_monitor(leds);
-	if (run_update_monitor) update_monitor.Start();
+	// everything from here on runs on the one event loop
+	EventLoop loop;
 	
-	// initialise device monitor
+	// initialise device monitor (first, so it commits LED changes before anyone reports them)
 	DeviceMonitor device_monitor;
-	device_monitor.Init( leds );
+	device_monitor.Init( compositor );
 	
-	// begin monitoring
-	device_monitor.Main( );
+	// serve disk stats (rendered by the device monitor as it samples)
+	MetricsServer metrics;
+	if ( metrics_addr ) {
+		metrics.Listen( metrics_addr, loop );
+		device_monitor.SetMetrics( &metrics );
+	}
+	device_monitor.Attach( loop );
+	
+	// let later invocations talk to us rather than the hardware
+	// (simulations leave the socket to the real daemon)
+	ControlServer control( compositor, override_frame );
+	if ( !simulate ) control.Listen( CONTROL_PATH, loop );
+	
+	// initialise update monitor
+	UpdateMonitor update_monitor(compositor);
+	if (run_update_monitor) update_monitor.Start(loop);
+	
+	// begin monitoring (helpers we spawn get neither real time priority,
+	// thanks to SCHED_RESET_ON_FORK, nor our CPU pinning and timer slack,
+	// which HelperProcess puts back around posix_spawn)
+	realtime_enter( realtime );
+	loop.Run( );
 	
 	if (run_update_monitor) update_monitor.Stop();
 	
+	if ( debug || verbose > 0 ) {
+		device_monitor.Report( );
+		loop.Report( );
+	}
 	// re-enable annoying blinking // leaving it disabled
 	//leds->SetSystemLed( LED_BLUE, LED_BLINK );
-    for( int i = 0; i < device_monitor.numDisks(); ++i )
-    {
-        int led_idx = device_monitor.ledIndex(i);
-        leds->Set( LED_RED, led_idx, false );
-        leds->Set( LED_BLUE, led_idx, false );
-    }
+	compositor->Reset( );
+	compositor->Commit( );
+	
+	if ( chipset && ( debug || verbose > 0 ) ) chipset->Report( );
 	
 	return 0;
 	
@@ -34,5 +34,10 @@
 extern int debug;
 extern int verbose;
 extern bool activity;
+extern int activity_interval;
+extern int activity_idle_interval;
+extern double activity_backoff;
+extern bool activity_intensity;
+extern bool update_native;
 
 #endif // INCLUDED_LED_MEDIASMARTSERVERD
@@ -0,0 +1,282 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file metrics_server.cpp
+///
+/// Prometheus text format metrics over HTTP
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+//- includes
+#include "metrics_server.h"
+#include "errno_exception.h"
+#include <iostream>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+
+//- constants
+static const size_t MAX_CLIENTS = 16;		///< most connections at once
+static const size_t MAX_REQUEST = 8192;		///< longest request we'll wait for the end of
+static const unsigned long long CLIENT_TIMEOUT_MS = 5000;	///< longest a connection may take to ask and be answered
+
+/////////////////////////////////////////////////////////////////////////////
+/// monotonic clock in milliseconds
+static unsigned long long monotonic_ms( ) {
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return now.tv_sec * 1000ULL + now.tv_nsec / 1000000;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// constructor
+MetricsServer::MetricsServer( )
+	:	loop_( 0 )
+	,	listen_fd_( -1 )
+	,	timer_fd_( -1 )
+	,	armed_ms_( 0 )
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// destructor
+MetricsServer::~MetricsServer( ) {
+	while ( !clients_.empty() ) drop_( clients_.size() - 1 );
+	
+	if ( -1 != listen_fd_ ) {
+		loop_->Remove( listen_fd_ );
+		close( listen_fd_ );
+		loop_->Remove( timer_fd_ );
+		close( timer_fd_ );
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// start listening
+bool MetricsServer::Listen( const char* addr, EventLoop& loop ) {
+	// [ADDRESS:]PORT
+	std::string host( "127.0.0.1" );
+	const char* port = strrchr( addr, ':' );
+	if ( port ) {
+		host.assign( addr, port - addr );
+		++port;
+	} else {
+		port = addr;
+	}
+	
+	sockaddr_in sin;
+	memset( &sin, 0, sizeof(sin) );
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons( atoi( port ) );
+	if ( !sin.sin_port || 1 != inet_pton( AF_INET, host.c_str(), &sin.sin_addr ) ) {
+		std::cout << "Bad metrics address: " << addr << '\n';
+		return false;
+	}
+	
+	const int fd = socket( AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0 );
+	if ( -1 == fd ) throw ErrnoException( "socket" );
+	
+	const int on = 1;
+	setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on) );
+	
+	if ( -1 == bind( fd, (const sockaddr*)&sin, sizeof(sin) ) || -1 == listen( fd, 8 ) ) {
+		std::cout << "Metrics on " << addr << ": " << strerror( errno ) << ", carrying on without them\n";
+		close( fd );
+		return false;
+	}
+	
+	timer_fd_ = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC );
+	if ( -1 == timer_fd_ ) {
+		const int err = errno;
+		close( fd );
+		errno = err;
+		throw ErrnoException( "timerfd_create" );
+	}
+	
+	listen_fd_ = fd;
+	loop_ = &loop;
+	loop_->Add( listen_fd_, this, "metrics" );
+	loop_->Add( timer_fd_, this, "metrics" );
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// serve the page rendered into Page() from now on
+void MetricsServer::Publish( ) {
+	// swapping keeps both buffers' capacity, so steady state doesn't allocate
+	page_.swap( next_ );
+	next_.clear( );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// one of our sockets is ready, or a client's time is up
+void MetricsServer::OnEvent( int fd, unsigned int /*events*/ ) {
+	if ( fd == listen_fd_ ) {
+		accept_( );
+	} else if ( fd == timer_fd_ ) {
+		expire_( );
+	} else {
+		for ( size_t i = 0; i < clients_.size(); ++i ) {
+			if ( clients_[i].fd != fd ) continue;
+			Client& client = clients_[i];
+			if ( !( ( client.out.empty() ) ? read_( client ) : write_( client ) ) ) drop_( i );
+			break;
+		}
+	}
+	arm_( );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// take on new connections
+void MetricsServer::accept_( ) {
+	for ( ;; ) {
+		const int fd = accept4( listen_fd_, 0, 0, SOCK_CLOEXEC | SOCK_NONBLOCK );
+		if ( -1 == fd ) return;
+		
+		if ( clients_.size() >= MAX_CLIENTS ) {
+			close( fd );
+			continue;
+		}
+		
+		// deadlines go up along clients_, so the first is always the next due
+		Client client = { fd, monotonic_ms( ) + CLIENT_TIMEOUT_MS, 0, 0, std::string( ) };
+		clients_.push_back( client );
+		loop_->Add( fd, this, "metrics" );
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// read more of a request, answering it once the headers are in
+/// @return false if the connection is finished with
+bool MetricsServer::read_( Client& client ) {
+	char buf[1024];
+	const ssize_t len = recv( client.fd, buf, sizeof(buf), 0 );
+	if ( -1 == len ) return ( EAGAIN == errno || EINTR == errno );
+	if ( 0 == len ) return false;
+	
+	// we don't care what was asked for, just where the headers end
+	for ( ssize_t i = 0; i < len; ++i ) {
+		if ( '\n' == buf[i] ) {
+			if ( 2 == ++client.newlines ) return respond_( client );
+		} else if ( '\r' != buf[i] ) {
+			client.newlines = 0;
+		}
+	}
+	
+	client.received += len;
+	return client.received < MAX_REQUEST;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// send the page
+/// @return false if it's all gone (or the connection failed)
+bool MetricsServer::respond_( Client& client ) {
+	char header[160];
+	const int header_len = snprintf( header, sizeof(header),
+		"HTTP/1.0 200 OK\r\n"
+		"Content-Type: text/plain; version=0.0.4\r\n"
+		"Content-Length: %lu\r\n"
+		"Connection: close\r\n"
+		"\r\n", (unsigned long)page_.size() );
+	
+	iovec iov[2];
+	iov[0].iov_base = header;
+	iov[0].iov_len = header_len;
+	iov[1].iov_base = (void*)page_.data();
+	iov[1].iov_len = page_.size();
+	
+	msghdr msg;
+	memset( &msg, 0, sizeof(msg) );
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 2;
+	
+	// a page usually fits in the socket buffer, so one go does it
+	const ssize_t sent = sendmsg( client.fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT );
+	if ( -1 == sent && EAGAIN != errno && EINTR != errno ) return false;
+	
+	const size_t done = ( sent > 0 ) ? sent : 0;
+	if ( done == header_len + page_.size() ) return false;
+	
+	// otherwise keep what's left (the page may be republished meanwhile) and wait for room
+	client.out.reserve( header_len + page_.size() - done );
+	if ( done < (size_t)header_len ) {
+		client.out.assign( header + done, header_len - done );
+		client.out.append( page_ );
+	} else {
+		client.out.assign( page_, done - header_len, std::string::npos );
+	}
+	loop_->Modify( client.fd, EPOLLOUT );
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// send more of a response that didn't go in one
+/// @return false if it's all gone (or the connection failed)
+bool MetricsServer::write_( Client& client ) {
+	const ssize_t sent = send( client.fd, client.out.data(), client.out.size(), MSG_NOSIGNAL | MSG_DONTWAIT );
+	if ( -1 == sent ) return ( EAGAIN == errno || EINTR == errno );
+	
+	client.out.erase( 0, sent );
+	return !client.out.empty();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// drop clients that have run out of time
+void MetricsServer::expire_( ) {
+	unsigned long long expirations;
+	if ( sizeof(expirations) != read( timer_fd_, &expirations, sizeof(expirations) ) ) return;
+	armed_ms_ = 0;
+	
+	const unsigned long long now_ms = monotonic_ms( );
+	while ( !clients_.empty() && clients_.front().deadline_ms <= now_ms ) drop_( 0 );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// set the timer for the first client's deadline (or stop it)
+void MetricsServer::arm_( ) {
+	const unsigned long long deadline_ms = ( clients_.empty() ) ? 0 : clients_.front().deadline_ms;
+	if ( deadline_ms == armed_ms_ ) return;
+	armed_ms_ = deadline_ms;
+	
+	struct itimerspec spec = { { 0, 0 }, { 0, 0 } };
+	spec.it_value.tv_sec  = deadline_ms / 1000;
+	spec.it_value.tv_nsec = ( deadline_ms % 1000 ) * 1000000;
+	if ( timerfd_settime( timer_fd_, TFD_TIMER_ABSTIME, &spec, 0 ) ) throw ErrnoException( "timerfd_settime" );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// close a connection
+void MetricsServer::drop_( size_t idx ) {
+	loop_->Remove( clients_[idx].fd );
+	close( clients_[idx].fd );
+	clients_.erase( clients_.begin() + idx );
+}
@@ -0,0 +1,98 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file metrics_server.h
+///
+/// Prometheus text format metrics over HTTP
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_METRICS_SERVER
+#define INCLUDED_METRICS_SERVER
+
+//- includes
+#include "event_loop.h"
+#include <string>
+#include <vector>
+
+/////////////////////////////////////////////////////////////////////////////
+/// serves a preformatted page of Prometheus metrics over HTTP
+///
+/// Whoever collects the numbers renders the page into Page() once per
+/// sample and calls Publish(). Scrapes just send the last published page,
+/// so they never cost any extra sampling. Any GET gets the page, whatever
+/// the path. A connection that hasn't been answered in full within a few
+/// seconds is dropped, so idle ones can't keep scrapers out.
+class MetricsServer : public EventHandler {
+public:
+	MetricsServer( );
+	~MetricsServer( );
+	
+	/// start listening (on loop)
+	/// @param addr "[ADDRESS:]PORT", address defaulting to 127.0.0.1
+	/// @return false (having said why) if we can't
+	bool Listen( const char* addr, EventLoop& loop );
+	
+	/// listening?
+	bool Listening( ) const { return -1 != listen_fd_; }
+	
+	/// page to render the next update into (starts out empty)
+	std::string& Page( ) { return next_; }
+	
+	/// serve the page rendered into Page() from now on
+	void Publish( );
+	
+	virtual void OnEvent( int fd, unsigned int events );
+	
+private:
+	/// a connection reading its request or being sent the page
+	struct Client {
+		int					fd;				///< connection
+		unsigned long long	deadline_ms;	///< dropped if not finished with by then (CLOCK_MONOTONIC)
+		size_t				received;		///< request bytes so far
+		int					newlines;		///< consecutive line ends seen (2 ends the headers)
+		std::string			out;			///< response still to send (empty until a send falls short)
+	};
+	
+	void accept_( );
+	bool read_( Client& client );
+	bool respond_( Client& client );
+	bool write_( Client& client );
+	void expire_( );
+	void arm_( );
+	void drop_( size_t idx );
+	
+	EventLoop*				loop_;		///< where our sockets are watched
+	int						listen_fd_;	///< listening socket
+	int						timer_fd_;	///< goes off at the first client's deadline
+	unsigned long long		armed_ms_;	///< deadline timer_fd_ is set for (0 if none)
+	std::vector< Client >	clients_;	///< connections
+	std::string				page_;		///< page being served
+	std::string				next_;		///< page being rendered
+	
+	// no copying
+	MetricsServer( const MetricsServer& rhs );
+	const MetricsServer& operator=( const MetricsServer& rhs );
+};
+
+#endif // INCLUDED_METRICS_SERVER
@@ -0,0 +1,369 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file package_counter.cpp
+///
+/// Counts upgradable packages from the dpkg status and apt lists
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+//- includes
+#include "package_counter.h"
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/////////////////////////////////////////////////////////////////////////////
+/// a file mapped read only for the lifetime of the object
+class MappedFile {
+public:
+	explicit MappedFile( const std::string& path ) : data_( 0 ), size_( 0 ) {
+		const int fd = open( path.c_str(), O_RDONLY | O_CLOEXEC );
+		if ( -1 == fd ) return;
+		
+		struct stat st;
+		if ( 0 == fstat( fd, &st ) && st.st_size > 0 ) {
+			void* data = mmap( 0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+			if ( MAP_FAILED != data ) {
+				madvise( data, st.st_size, MADV_SEQUENTIAL );
+				data_ = (const char*)data;
+				size_ = st.st_size;
+			}
+		}
+		close( fd );
+	}
+	~MappedFile( ) { if ( data_ ) munmap( (void*)data_, size_ ); }
+	
+	bool Ok( ) const { return 0 != data_; }
+	const char* Begin( ) const { return data_; }
+	const char* End( ) const { return data_ + size_; }
+	
+private:
+	const char*	data_;	///< mapping (0 if none)
+	size_t		size_;	///< length of mapping
+	
+	// no copying
+	MappedFile( const MappedFile& rhs );
+	const MappedFile& operator=( const MappedFile& rhs );
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// a run of characters in a mapped file
+struct Span {
+	Span( ) : ptr( 0 ), len( 0 ) { }
+	
+	bool Equals( const char* str ) const { return len == strlen( str ) && 0 == memcmp( ptr, str, len ); }
+	
+	const char*	ptr;
+	size_t		len;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// the fields we care about from one stanza of a dpkg status or Packages file
+struct Stanza {
+	Span	package;
+	Span	arch;
+	Span	version;
+	Span	status;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// if a line is the given field, point value at its (trimmed) value
+static bool field( const char* line, const char* eol, const char* name, size_t name_len, Span& value ) {
+	if ( (size_t)( eol - line ) <= name_len || 0 != memcmp( line, name, name_len ) ) return false;
+	
+	const char* ptr = line + name_len;
+	while ( ptr < eol && ' ' == *ptr ) ++ptr;
+	const char* end = eol;
+	while ( end > ptr && ( ' ' == end[-1] || '\r' == end[-1] ) ) --end;
+	
+	value.ptr = ptr;
+	value.len = end - ptr;
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// walk the stanzas of a deb822 file, handing each to a functor
+template< class Fn >
+static void for_each_stanza( const char* ptr, const char* end, Fn& fn ) {
+	Stanza stanza;
+	while ( ptr < end ) {
+		const char* eol = (const char*)memchr( ptr, '\n', end - ptr );
+		if ( !eol ) eol = end;
+		
+		// only the first letter is checked before comparing whole names
+		switch ( *ptr ) {
+		case '\n':
+		case '\r':
+			if ( stanza.package.len ) fn( stanza );
+			stanza = Stanza( );
+			break;
+		case 'P': field( ptr, eol, "Package:",      8,  stanza.package ); break;
+		case 'A': field( ptr, eol, "Architecture:", 13, stanza.arch    ); break;
+		case 'V': field( ptr, eol, "Version:",      8,  stanza.version ); break;
+		case 'S': field( ptr, eol, "Status:",       7,  stanza.status  ); break;
+		}
+		
+		ptr = eol + 1;
+	}
+	if ( stanza.package.len ) fn( stanza );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// dpkg's ordering of non-digit version characters
+static int version_order( int c ) {
+	if ( c >= '0' && c <= '9' ) return 0;
+	if ( ( c >= 'a' && c <= 'z' ) || ( c >= 'A' && c <= 'Z' ) ) return c;
+	if ( '~' == c ) return -1;
+	if ( c ) return c + 256;
+	return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// is there a digit at ptr?
+static inline bool is_digit( const char* ptr, const char* end ) {
+	return ptr < end && *ptr >= '0' && *ptr <= '9';
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// compare upstream versions or revisions the way dpkg does
+static int version_part_compare( const char* a, const char* a_end, const char* b, const char* b_end ) {
+	while ( a < a_end || b < b_end ) {
+		// non-digit runs, character by character
+		while ( ( a < a_end && !is_digit( a, a_end ) ) || ( b < b_end && !is_digit( b, b_end ) ) ) {
+			const int ac = ( a < a_end ) ? version_order( *a ) : 0;
+			const int bc = ( b < b_end ) ? version_order( *b ) : 0;
+			if ( ac != bc ) return ac - bc;
+			++a;
+			++b;
+		}
+		
+		// digit runs, numerically
+		while ( a < a_end && '0' == *a ) ++a;
+		while ( b < b_end && '0' == *b ) ++b;
+		
+		int first_diff = 0;
+		while ( is_digit( a, a_end ) && is_digit( b, b_end ) ) {
+			if ( !first_diff ) first_diff = *a - *b;
+			++a;
+			++b;
+		}
+		if ( is_digit( a, a_end ) ) return 1;
+		if ( is_digit( b, b_end ) ) return -1;
+		if ( first_diff ) return first_diff;
+	}
+	return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// compare two Debian package versions (as dpkg --compare-versions does)
+int debian_version_compare( const char* a, size_t a_len, const char* b, size_t b_len ) {
+	const char* a_end = a + a_len;
+	const char* b_end = b + b_len;
+	
+	// [epoch:]upstream[-revision]
+	const char* a_colon = (const char*)memchr( a, ':', a_len );
+	const char* b_colon = (const char*)memchr( b, ':', b_len );
+	unsigned long a_epoch = 0, b_epoch = 0;
+	if ( a_colon ) { for ( const char* p = a; p < a_colon; ++p ) a_epoch = a_epoch * 10 + ( *p - '0' ); a = a_colon + 1; }
+	if ( b_colon ) { for ( const char* p = b; p < b_colon; ++p ) b_epoch = b_epoch * 10 + ( *p - '0' ); b = b_colon + 1; }
+	if ( a_epoch != b_epoch ) return ( a_epoch < b_epoch ) ? -1 : 1;
+	
+	const char* a_dash = a_end;
+	while ( a_dash > a && '-' != a_dash[-1] ) --a_dash;
+	const char* a_upstream_end = ( a_dash > a ) ? a_dash - 1 : a_end;
+	const char* a_revision = ( a_dash > a ) ? a_dash : a_end;
+	
+	const char* b_dash = b_end;
+	while ( b_dash > b && '-' != b_dash[-1] ) --b_dash;
+	const char* b_upstream_end = ( b_dash > b ) ? b_dash - 1 : b_end;
+	const char* b_revision = ( b_dash > b ) ? b_dash : b_end;
+	
+	const int res = version_part_compare( a, a_upstream_end, b, b_upstream_end );
+	if ( res ) return res;
+	return version_part_compare( a_revision, a_end, b_revision, b_end );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// hash of a package name and architecture (FNV-1a)
+static uint32_t package_hash( const Span& name, const Span& arch ) {
+	uint32_t hash = 2166136261U;
+	for ( size_t i = 0; i < name.len; ++i ) hash = ( hash ^ (unsigned char)name.ptr[i] ) * 16777619U;
+	hash = ( hash ^ '/' ) * 16777619U;
+	for ( size_t i = 0; i < arch.len; ++i ) hash = ( hash ^ (unsigned char)arch.ptr[i] ) * 16777619U;
+	return hash;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// installed packages, indexed by name and architecture
+///
+/// Entries are offsets into the mapped dpkg status rather than copies.
+class InstalledIndex {
+public:
+	enum {
+		UPGRADABLE	= 1 << 0,	///< newer version in some list
+		SECURITY	= 1 << 1,	///< newer version in a security list
+	};
+	
+	explicit InstalledIndex( const char* base ) : base_( base ) { }
+	
+	/// add a stanza from the dpkg status (if it's installed)
+	void operator()( const Stanza& stanza ) {
+		if ( !stanza.status.Equals( "install ok installed" ) || !stanza.version.len ) return;
+		
+		Entry entry;
+		entry.hash			= package_hash( stanza.package, stanza.arch );
+		entry.name			= stanza.package.ptr - base_;
+		entry.arch			= stanza.arch.ptr - base_;
+		entry.version		= stanza.version.ptr - base_;
+		entry.name_len		= stanza.package.len;
+		entry.arch_len		= stanza.arch.len;
+		entry.version_len	= stanza.version.len;
+		entry.flags			= 0;
+		entries_.push_back( entry );
+	}
+	
+	/// build the hash table once everything is added
+	void Build( ) {
+		size_t size = 64;
+		while ( size < entries_.size() * 2 ) size *= 2;
+		slots_.assign( size, 0 );
+		
+		for ( size_t i = 0; i < entries_.size(); ++i ) {
+			size_t slot = entries_[i].hash & ( size - 1 );
+			while ( slots_[slot] ) slot = ( slot + 1 ) & ( size - 1 );
+			slots_[slot] = i + 1;
+		}
+	}
+	
+	/// note a version available from a list
+	void Offer( const Stanza& stanza, bool security ) {
+		if ( !stanza.version.len ) return;
+		
+		const uint32_t hash = package_hash( stanza.package, stanza.arch );
+		const size_t mask = slots_.size() - 1;
+		for ( size_t slot = hash & mask; slots_[slot]; slot = ( slot + 1 ) & mask ) {
+			Entry& entry = entries_[slots_[slot] - 1];
+			if ( entry.hash != hash
+				|| entry.name_len != stanza.package.len || 0 != memcmp( base_ + entry.name, stanza.package.ptr, entry.name_len )
+				|| entry.arch_len != stanza.arch.len    || 0 != memcmp( base_ + entry.arch, stanza.arch.ptr, entry.arch_len ) )
+			{
+				continue;
+			}
+			
+			const int wanted = ( security ) ? UPGRADABLE | SECURITY : UPGRADABLE;
+			if ( wanted == ( entry.flags & wanted ) ) return;
+			if ( debian_version_compare( stanza.version.ptr, stanza.version.len, base_ + entry.version, entry.version_len ) > 0 ) {
+				entry.flags |= wanted;
+			}
+			return;
+		}
+	}
+	
+	/// count packages with a flag set
+	int Count( int flag ) const {
+		int cnt = 0;
+		for ( size_t i = 0; i < entries_.size(); ++i ) if ( entries_[i].flags & flag ) ++cnt;
+		return cnt;
+	}
+	
+private:
+	/// an installed package
+	struct Entry {
+		uint32_t		hash;			///< package_hash()
+		uint32_t		name;			///< offset of name
+		uint32_t		arch;			///< offset of architecture
+		uint32_t		version;		///< offset of version
+		unsigned short	name_len;
+		unsigned short	arch_len;
+		unsigned short	version_len;
+		unsigned char	flags;			///< UPGRADABLE, SECURITY
+	};
+	
+	const char*					base_;		///< mapped dpkg status
+	std::vector< Entry >		entries_;	///< installed packages
+	std::vector< uint32_t >		slots_;		///< open addressed table of entry index + 1 (0 if empty)
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// passes the stanzas of a package list on to the installed index
+struct ListOffers {
+	ListOffers( InstalledIndex& index, bool security ) : index_( index ), security_( security ) { }
+	void operator()( const Stanza& stanza ) { index_.Offer( stanza, security_ ); }
+	
+	InstalledIndex&	index_;
+	bool			security_;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// constructor
+PackageCounter::PackageCounter( const std::string& root )
+	:	root_( root )
+	,	lists_read_( 0 )
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// count upgradable packages
+bool PackageCounter::Count( int& updates, int& security_updates ) {
+	lists_read_ = 0;
+	
+	MappedFile status( root_ + "/var/lib/dpkg/status" );
+	if ( !status.Ok( ) ) return false;
+	
+	InstalledIndex index( status.Begin( ) );
+	for_each_stanza( status.Begin( ), status.End( ), index );
+	index.Build( );
+	
+	const std::string lists_dir = root_ + "/var/lib/apt/lists";
+	DIR* dir = opendir( lists_dir.c_str() );
+	if ( !dir ) return false;
+	
+	// uncompressed lists only (e.g. archive.ubuntu.com_ubuntu_dists_jammy-security_main_binary-amd64_Packages)
+	static const char SUFFIX[] = "_Packages";
+	const size_t suffix_len = sizeof(SUFFIX) - 1;
+	while ( const dirent* ent = readdir( dir ) ) {
+		const size_t len = strlen( ent->d_name );
+		if ( len <= suffix_len || 0 != strcmp( ent->d_name + len - suffix_len, SUFFIX ) ) continue;
+		
+		MappedFile list( lists_dir + '/' + ent->d_name );
+		if ( !list.Ok( ) ) continue;
+		
+		ListOffers offers( index, 0 != strstr( ent->d_name, "security" ) );
+		for_each_stanza( list.Begin( ), list.End( ), offers );
+		++lists_read_;
+	}
+	closedir( dir );
+	
+	// nothing to compare against (compressed lists?), so we can't tell
+	if ( !lists_read_ ) return false;
+	
+	updates = index.Count( InstalledIndex::UPGRADABLE );
+	security_updates = index.Count( InstalledIndex::SECURITY );
+	return true;
+}
@@ -0,0 +1,68 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file package_counter.h
+///
+/// Counts upgradable packages from the dpkg status and apt lists
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_PACKAGE_COUNTER
+#define INCLUDED_PACKAGE_COUNTER
+
+//- includes
+#include <string>
+#include <stddef.h>
+
+/////////////////////////////////////////////////////////////////////////////
+/// compare two Debian package versions (as dpkg --compare-versions does)
+/// @return Less than, equal to or greater than 0 as a is older, the same or newer
+int debian_version_compare( const char* a, size_t a_len, const char* b, size_t b_len );
+
+/////////////////////////////////////////////////////////////////////////////
+/// counts installed packages with newer versions in the apt lists
+///
+/// A cheap stand-in for apt-check: the files are mapped and parsed in
+/// place, with installed versions held in a hash index pointing into the
+/// mapped dpkg status. It doesn't know about pinning or phased updates, so
+/// an upgrade is any newer version in any list, and a security upgrade is
+/// one in a list from a security archive.
+class PackageCounter {
+public:
+	/// constructor
+	/// @param root Prefix for /var/lib/dpkg and /var/lib/apt/lists (to count a fixture tree)
+	explicit PackageCounter( const std::string& root = "" );
+	
+	/// count upgradable packages
+	/// @return false if the dpkg status or the package lists couldn't be read
+	bool Count( int& updates, int& security_updates );
+	
+	/// package lists read by the last Count()
+	size_t ListsRead( ) const { return lists_read_; }
+	
+private:
+	std::string	root_;			///< prefix for paths
+	size_t		lists_read_;	///< package lists read by the last Count()
+};
+
+#endif // INCLUDED_PACKAGE_COUNTER
@@ -0,0 +1,69 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file port_io.h
+///
+/// Port I/O backends for the LED drivers
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_PORT_IO
+#define INCLUDED_PORT_IO
+
+//- includes
+#include <sys/io.h>
+
+/////////////////////////////////////////////////////////////////////////////
+/// where the LED drivers' port I/O goes
+///
+/// The hardware unless something else (see SimulatedChipset) is swapped in
+/// before the LED drivers are initialised.
+class PortIo {
+public:
+	virtual ~PortIo( ) { }
+	
+	/// get or drop access to num ports from from (see ioperm(2))
+	/// @return 0 on success
+	virtual int Perm( unsigned long from, unsigned long num, int turn_on ) = 0;
+	
+	virtual unsigned char InB( unsigned short port ) = 0;
+	virtual unsigned int InL( unsigned short port ) = 0;
+	virtual void OutB( unsigned char val, unsigned short port ) = 0;
+	virtual void OutL( unsigned int val, unsigned short port ) = 0;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// port I/O straight to the hardware
+class HardwarePortIo : public PortIo {
+public:
+	virtual int Perm( unsigned long from, unsigned long num, int turn_on ) { return ioperm( from, num, turn_on ); }
+	virtual unsigned char InB( unsigned short port ) { return inb( port ); }
+	virtual unsigned int InL( unsigned short port ) { return inl( port ); }
+	virtual void OutB( unsigned char val, unsigned short port ) { outb( val, port ); }
+	virtual void OutL( unsigned int val, unsigned short port ) { outl( val, port ); }
+};
+
+/// backend the LED drivers use (the hardware by default)
+extern PortIo* port_io;
+
+#endif // INCLUDED_PORT_IO
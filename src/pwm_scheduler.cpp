@@ -0,0 +1,176 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file pwm_scheduler.cpp
+///
+/// Software PWM for LEDs with edges planned ahead
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+//- includes
+#include "pwm_scheduler.h"
+#include "errno_exception.h"
+#include <algorithm>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+/// length of a slot
+static const unsigned long long SLOT_NS = PwmScheduler::PERIOD_MS * 1000000ULL / PwmScheduler::SLOTS;
+
+/////////////////////////////////////////////////////////////////////////////
+/// monotonic clock in nanoseconds
+static unsigned long long monotonic_ns( ) {
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return (unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// constructor
+PwmScheduler::PwmScheduler( )
+	:	fd_( -1 )
+	,	running_( false )
+	,	lit_( 0 )
+	,	period_ns_( 0 )
+	,	on_( 0 )
+	,	slot_( 0 )
+{
+	std::fill( duty_,  duty_  + MAX_CHANNELS, 0 );
+	std::fill( error_, error_ + MAX_CHANNELS, 0 );
+	std::fill( off_,   off_   + SLOTS, 0 );
+	
+	fd_ = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC );
+	if ( fd_ < 0 ) throw ErrnoException( "timerfd_create" );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// destructor
+PwmScheduler::~PwmScheduler( ) {
+	close( fd_ );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// set a channel's duty cycle, taking effect next period
+void PwmScheduler::SetDuty( size_t channel, unsigned int duty ) {
+	if ( channel >= MAX_CHANNELS ) return;
+	duty_[channel] = std::min<unsigned int>( duty, DUTY_MAX );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// start or stop edges after duty cycles change
+void PwmScheduler::Sync( ) {
+	unsigned int partial = 0, full = 0;
+	for ( size_t i = 0; i < MAX_CHANNELS; ++i ) {
+		if ( DUTY_MAX == duty_[i] ) {
+			full |= 1U << i;
+		} else if ( duty_[i] ) {
+			partial |= 1U << i;
+		}
+	}
+	
+	// nothing to modulate, so no need to wake up at all
+	if ( !partial ) {
+		if ( running_ ) {
+			running_ = false;
+			arm_( 0 );
+		}
+		lit_ = full;
+		return;
+	}
+	
+	// first edge straight away
+	if ( !running_ ) {
+		running_ = true;
+		period_ns_ = monotonic_ns( );
+		plan_( );
+		arm_( period_ns_ );
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// apply the edges due once Fd() is readable
+bool PwmScheduler::Expired( ) {
+	unsigned long long expirations = 0;
+	if ( sizeof(expirations) != read( fd_, &expirations, sizeof(expirations) ) ) {
+		if ( EAGAIN == errno ) return false;
+		throw ErrnoException( "read(timerfd)" );
+	}
+	if ( !running_ ) return false;
+	
+	const unsigned int before = lit_;
+	const unsigned long long now_ns = monotonic_ns( );
+	while ( period_ns_ + slot_ * SLOT_NS <= now_ns ) {
+		if ( 0 == slot_ ) {
+			lit_ = on_;
+		} else {
+			lit_ &= ~off_[slot_];
+		}
+		
+		// next slot with an edge
+		do { ++slot_; } while ( slot_ < SLOTS && !off_[slot_] );
+		
+		if ( SLOTS == slot_ ) {
+			// on to the next period (starting afresh if we fell a long way behind)
+			period_ns_ += PERIOD_MS * 1000000ULL;
+			if ( period_ns_ + PERIOD_MS * 1000000ULL <= now_ns ) period_ns_ = now_ns;
+			plan_( );
+		}
+	}
+	arm_( period_ns_ + slot_ * SLOT_NS );
+	
+	return lit_ != before;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// work out the edges for the period starting at period_ns_
+void PwmScheduler::plan_( ) {
+	on_ = 0;
+	std::fill( off_, off_ + SLOTS, 0 );
+	
+	for ( size_t i = 0; i < MAX_CHANNELS; ++i ) {
+		// whole slots this period, carrying the remainder over
+		const unsigned int target = duty_[i] * SLOTS + error_[i];
+		const unsigned int slots = std::min<unsigned int>( target / DUTY_MAX, SLOTS );
+		error_[i] = target - slots * DUTY_MAX;
+		
+		if ( slots ) on_ |= 1U << i;
+		if ( slots && slots < SLOTS ) off_[slots] |= 1U << i;
+	}
+	slot_ = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// arm the timer for an absolute deadline (0 disarms it)
+void PwmScheduler::arm_( unsigned long long deadline_ns ) {
+	struct itimerspec spec = { { 0, 0 }, { 0, 0 } };
+	spec.it_value.tv_sec  = deadline_ns / 1000000000ULL;
+	spec.it_value.tv_nsec = deadline_ns % 1000000000ULL;
+	if ( !deadline_ns ) {
+		if ( timerfd_settime( fd_, 0, &spec, 0 ) ) throw ErrnoException( "timerfd_settime" );
+	} else {
+		if ( timerfd_settime( fd_, TFD_TIMER_ABSTIME, &spec, 0 ) ) throw ErrnoException( "timerfd_settime" );
+	}
+}
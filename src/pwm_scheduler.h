@@ -0,0 +1,96 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file pwm_scheduler.h
+///
+/// Software PWM for LEDs with edges planned ahead
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_PWM_SCHEDULER
+#define INCLUDED_PWM_SCHEDULER
+
+//- includes
+#include <stddef.h>
+
+/////////////////////////////////////////////////////////////////////////////
+/// software PWM for LEDs with edges planned ahead
+///
+/// Each period every partly lit channel turns on at the start and off at
+/// one of SLOTS slot boundaries. Duty cycles are quantised to slots with
+/// per-channel error diffusion, so the average over a few periods is exact
+/// while channels with similar duty share their off edge. The timerfd is
+/// armed for the next planned edge only, giving at most 1 + SLOTS - 1
+/// wakeups per period no matter how many channels there are, and none at
+/// all while every channel is fully on or off.
+class PwmScheduler {
+public:
+	enum {
+		MAX_CHANNELS	= 8,			///< channels (bit per channel in masks)
+		DUTY_MAX		= 256,			///< duty cycle of a fully lit channel
+		PERIOD_MS		= 10,			///< PWM period
+		SLOTS			= 10,			///< duty cycle steps per period
+	};
+	
+	PwmScheduler( );
+	~PwmScheduler( );
+	
+	/// set a channel's duty cycle (0 to DUTY_MAX), taking effect next period
+	void SetDuty( size_t channel, unsigned int duty );
+	
+	/// start or stop edges after duty cycles change
+	void Sync( );
+	
+	/// file descriptor to wait on for the next edge
+	int Fd( ) const { return fd_; }
+	
+	/// are edges being scheduled?
+	bool Running( ) const { return running_; }
+	
+	/// apply the edges due once Fd() is readable
+	/// @return whether any channel changed
+	bool Expired( );
+	
+	/// channels currently lit (bit per channel)
+	unsigned int Lit( ) const { return lit_; }
+	
+private:
+	void plan_( );
+	void arm_( unsigned long long deadline_ns );
+	
+	int					fd_;						///< timerfd
+	bool				running_;					///< scheduling edges?
+	unsigned int		lit_;						///< channels lit
+	unsigned int		duty_[MAX_CHANNELS];		///< duty cycles
+	unsigned int		error_[MAX_CHANNELS];		///< quantisation error carried to the next period
+	unsigned long long	period_ns_;					///< start of the current period (CLOCK_MONOTONIC)
+	unsigned int		on_;						///< channels turned on at the start of the period
+	unsigned int		off_[SLOTS];				///< channels turned off at each slot boundary
+	size_t				slot_;						///< next slot boundary with an edge (SLOTS = next period)
+	
+	// no copying
+	PwmScheduler( const PwmScheduler& rhs );
+	const PwmScheduler& operator=( const PwmScheduler& rhs );
+};
+
+#endif // INCLUDED_PWM_SCHEDULER
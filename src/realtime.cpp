@@ -0,0 +1,158 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file realtime.cpp
+///
+/// Real time scheduling for the LED loops
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+//- includes
+#include "realtime.h"
+#include "mediasmartserverd.h"
+#include <algorithm>
+#include <iostream>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+
+#ifndef SCHED_RESET_ON_FORK
+#define SCHED_RESET_ON_FORK 0x40000000
+#endif
+
+//- what realtime_enter changed, and what it was before
+static bool pinned = false;			///< CPU affinity set?
+static cpu_set_t pinned_cpus;		///< affinity set
+static cpu_set_t original_cpus;		///< affinity before
+static bool slack_set = false;		///< timer slack set?
+static unsigned long slack_ns = 0;	///< timer slack set
+static unsigned long original_slack_ns = 0;	///< timer slack before
+
+/////////////////////////////////////////////////////////////////////////////
+/// report a real time step we couldn't take
+static void realtime_warn( const char* what ) {
+	std::cout << "Real time: " << what << " failed (" << strerror( errno ) << "), carrying on without it\n";
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// fault in some stack now so we don't page fault in the loop later
+static void prefault_stack( ) {
+	volatile char stack[64 * 1024];
+	for ( size_t i = 0; i < sizeof(stack); i += 4096 ) stack[i] = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// raise the resource limits real time mode needs while we're still root
+void realtime_raise_limits( const RealtimeConfig& config ) {
+	if ( config.priority <= 0 ) return;
+	
+	// failures just mean we weren't privileged to begin with
+	const struct rlimit memlock = { RLIM_INFINITY, RLIM_INFINITY };
+	setrlimit( RLIMIT_MEMLOCK, &memlock );
+	
+	const struct rlimit rtprio = { (rlim_t)config.priority, (rlim_t)config.priority };
+	struct rlimit cur;
+	if ( 0 == getrlimit( RLIMIT_RTPRIO, &cur ) && cur.rlim_max < rtprio.rlim_max ) setrlimit( RLIMIT_RTPRIO, &rtprio );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// lock memory and make the calling thread real time
+bool realtime_enter( const RealtimeConfig& config ) {
+	bool ok = true;
+	
+	if ( config.priority > 0 ) {
+		// no page faults once we're going
+		if ( mlockall( MCL_CURRENT | MCL_FUTURE ) ) {
+			realtime_warn( "mlockall" );
+			ok = false;
+		} else {
+			prefault_stack( );
+		}
+		
+		// children (apt-check etc) shouldn't inherit real time priority
+		struct sched_param param;
+		memset( &param, 0, sizeof(param) );
+		param.sched_priority = std::min( config.priority, sched_get_priority_max( SCHED_FIFO ) );
+		const int res = pthread_setschedparam( pthread_self( ), SCHED_FIFO | SCHED_RESET_ON_FORK, &param );
+		if ( res ) {
+			errno = res;
+			realtime_warn( "SCHED_FIFO" );
+			ok = false;
+		} else if ( debug || verbose > 0 ) {
+			std::cout << "Real time: SCHED_FIFO priority " << param.sched_priority << '\n';
+		}
+	}
+	
+	if ( config.cpu >= 0 ) {
+		cpu_set_t cpus;
+		CPU_ZERO( &cpus );
+		CPU_SET( config.cpu, &cpus );
+		int res = pthread_getaffinity_np( pthread_self( ), sizeof(original_cpus), &original_cpus );
+		if ( !res ) res = pthread_setaffinity_np( pthread_self( ), sizeof(cpus), &cpus );
+		if ( res ) {
+			errno = res;
+			realtime_warn( "CPU affinity" );
+			ok = false;
+		} else {
+			pinned = true;
+			pinned_cpus = cpus;
+			if ( debug || verbose > 0 ) std::cout << "Real time: pinned to CPU " << config.cpu << '\n';
+		}
+	}
+	
+	if ( config.timer_slack_ns >= 0 ) {
+		// 0 would mean "back to the default", 1ns is as tight as it gets
+		const unsigned long slack = std::max( 1L, config.timer_slack_ns );
+		const int original = prctl( PR_GET_TIMERSLACK, 0, 0, 0, 0 );
+		if ( original < 0 || prctl( PR_SET_TIMERSLACK, slack, 0, 0, 0 ) ) {
+			realtime_warn( "PR_SET_TIMERSLACK" );
+			ok = false;
+		} else {
+			slack_set = true;
+			slack_ns = slack;
+			original_slack_ns = original;
+			if ( debug || verbose > 0 ) std::cout << "Real time: timer slack " << slack << "ns\n";
+		}
+	}
+	
+	return ok;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// put the CPU affinity and timer slack back as they were
+RealtimeSuspend::RealtimeSuspend( ) {
+	if ( pinned ) pthread_setaffinity_np( pthread_self( ), sizeof(original_cpus), &original_cpus );
+	if ( slack_set ) prctl( PR_SET_TIMERSLACK, original_slack_ns, 0, 0, 0 );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// back to real time
+RealtimeSuspend::~RealtimeSuspend( ) {
+	if ( pinned ) pthread_setaffinity_np( pthread_self( ), sizeof(pinned_cpus), &pinned_cpus );
+	if ( slack_set ) prctl( PR_SET_TIMERSLACK, slack_ns, 0, 0, 0 );
+}
@@ -0,0 +1,74 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file realtime.h
+///
+/// Real time scheduling for the LED loops
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_REALTIME
+#define INCLUDED_REALTIME
+
+/////////////////////////////////////////////////////////////////////////////
+/// real time settings for the thread running the LEDs (--realtime)
+struct RealtimeConfig {
+	RealtimeConfig( ) : priority( 0 ), cpu( -1 ), timer_slack_ns( -1 ) { }
+	
+	int		priority;		///< SCHED_FIFO priority (0 to leave the scheduler alone)
+	int		cpu;			///< CPU to pin to (-1 for any)
+	long	timer_slack_ns;	///< timer slack (-1 to leave alone)
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// raise the resource limits real time mode needs while we're still root,
+/// so it keeps working after dropping privileges
+void realtime_raise_limits( const RealtimeConfig& config );
+
+/////////////////////////////////////////////////////////////////////////////
+/// lock memory and make the calling thread real time
+///
+/// Every step that fails (usually for lack of privileges) is reported and
+/// skipped, leaving us no worse off than without it.
+/// @return true if everything asked for took effect
+bool realtime_enter( const RealtimeConfig& config );
+
+/////////////////////////////////////////////////////////////////////////////
+/// undoes realtime_enter's CPU pinning and timer slack for as long as it
+/// exists, for starting helper processes
+///
+/// Both are per thread and a spawned child inherits them from the thread
+/// spawning it, which SCHED_RESET_ON_FORK does nothing about. posix_spawn
+/// suspends us until the child has exec'd, so the loop never runs unpinned.
+class RealtimeSuspend {
+public:
+	RealtimeSuspend( );
+	~RealtimeSuspend( );
+	
+private:
+	// no copying
+	RealtimeSuspend( const RealtimeSuspend& rhs );
+	const RealtimeSuspend& operator=( const RealtimeSuspend& rhs );
+};
+
+#endif // INCLUDED_REALTIME
@@ -0,0 +1,322 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file simulated_chipset.cpp
+///
+/// Simulated ICH9/SCH5127 register file for running without the hardware
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+//- includes
+#include "simulated_chipset.h"
+#include "mediasmartserverd.h"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+//- constants
+static const unsigned short PCI_CONFIG_ADDRESS	= 0x0CF8;
+static const unsigned short PCI_CONFIG_DATA		= 0x0CFC;
+static const unsigned int PCI_LPC_VENDOR_ID		= 0x8000F800;	///< bus 0, device 31, function 0, register 0x00
+static const unsigned int PCI_LPC_GPIOBASE		= 0x8000F848;	///< bus 0, device 31, function 0, register 0x48
+static const unsigned short SIO_PORTS[2]		= { 0x2e, 0x4e };
+
+/////////////////////////////////////////////////////////////////////////////
+/// monotonic clock in nanoseconds
+static unsigned long long monotonic_ns( ) {
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return (unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// what a port is, for reports
+static std::string port_name( unsigned short port ) {
+	static const struct {
+		unsigned short	offset;
+		const char*		name;
+	} GPIO_NAMES[] = {
+		{ 0x00, "GPIO_USE_SEL" }, { 0x04, "GP_IO_SEL" }, { 0x0C, "GP_LVL" }, { 0x18, "GPO_BLINK" },
+		{ 0x30, "GPIO_USE_SEL2" }, { 0x34, "GP_IO_SEL2" }, { 0x38, "GP_LVL2" },
+	}, RUNTIME_NAMES[] = {
+		{ 0x4B, "GP1" }, { 0x4C, "GP2" }, { 0x4D, "GP3" }, { 0x4E, "GP4" }, { 0x4F, "GP5" }, { 0x50, "GP6" },
+		{ 0x65, "WDT_TIME_OUT" }, { 0x66, "WDT_VAL" }, { 0x67, "WDT_CFG" }, { 0x68, "WDT_CTRL" },
+		{ 0x70, "HWM_INDEX" }, { 0x71, "HWM_DATA" },
+	};
+	
+	if ( PCI_CONFIG_ADDRESS == port ) return "PCI CONFIG_ADDRESS";
+	if ( PCI_CONFIG_DATA    == port ) return "PCI CONFIG_DATA";
+	for ( size_t i = 0; i < 2; ++i ) {
+		if ( SIO_PORTS[i]     == port ) return "SIO index";
+		if ( SIO_PORTS[i] + 1 == port ) return "SIO data";
+	}
+	for ( size_t i = 0; i < sizeof(GPIO_NAMES) / sizeof(GPIO_NAMES[0]); ++i ) {
+		if ( SimulatedChipset::GPIOBASE + GPIO_NAMES[i].offset == port ) return GPIO_NAMES[i].name;
+	}
+	for ( size_t i = 0; i < sizeof(RUNTIME_NAMES) / sizeof(RUNTIME_NAMES[0]); ++i ) {
+		if ( SimulatedChipset::RUNTIME_BASE + RUNTIME_NAMES[i].offset == port ) return RUNTIME_NAMES[i].name;
+	}
+	return "";
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// constructor
+SimulatedChipset::PortCounts::PortCounts( ) {
+	std::fill( op, op + OP_CNT, 0 );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// constructor
+SimulatedChipset::SimulatedChipset( unsigned int did_vid, unsigned int sio_port )
+	:	did_vid_( did_vid )
+	,	sio_port_( sio_port )
+	,	pci_address_( 0 )
+	,	sio_ldn_( 0 )
+	,	start_ns_( monotonic_ns( ) )
+	,	accesses_( 0 )
+	,	faults_( 0 )
+	,	unclaimed_( 0 )
+{
+	sio_config_[0] = sio_config_[1] = false;
+	sio_index_[0] = sio_index_[1] = 0;
+	std::fill( gpio_, gpio_ + GPIO_REGS, 0 );
+	std::fill( runtime_, runtime_ + RUNTIME_REGS, 0 );
+	std::fill( hwm_, hwm_ + sizeof(hwm_), 0 );
+	std::fill( perm_, perm_ + sizeof(perm_), 0 );
+	memset( trace_, 0, sizeof(trace_) );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// get or drop access to ports
+int SimulatedChipset::Perm( unsigned long from, unsigned long num, int turn_on ) {
+	if ( from >= 0x10000 || num > 0x10000 - from ) {
+		errno = EINVAL;
+		return -1;
+	}
+	
+	for ( unsigned long port = from; port < from + num; ++port ) {
+		if ( turn_on ) {
+			perm_[ port / 8 ] |= 1U << ( port % 8 );
+		} else {
+			perm_[ port / 8 ] &= ~( 1U << ( port % 8 ) );
+		}
+	}
+	return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+unsigned char SimulatedChipset::InB( unsigned short port ) {
+	const unsigned char val = read_( port, false );
+	record_( OP_INB, port, val );
+	return val;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+unsigned int SimulatedChipset::InL( unsigned short port ) {
+	const unsigned int val = read_( port, true );
+	record_( OP_INL, port, val );
+	return val;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void SimulatedChipset::OutB( unsigned char val, unsigned short port ) {
+	record_( OP_OUTB, port, val );
+	write_( port, val, false );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void SimulatedChipset::OutL( unsigned int val, unsigned short port ) {
+	record_( OP_OUTL, port, val );
+	write_( port, val, true );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// print access counts per port and the most recent accesses
+void SimulatedChipset::Report( ) const {
+	static const char* const OP_NAMES[OP_CNT] = { "inb", "inl", "outb", "outl" };
+	
+	const std::ios::fmtflags flags = std::cout.flags( );
+	const std::streamsize precision = std::cout.precision( );
+	const char fill = std::cout.fill( );
+	
+	std::cout << "simulated chipset: " << accesses_ << " accesses, " << faults_ << " without permission, "
+		<< unclaimed_ << " unclaimed\n" << std::hex << std::setfill( '0' );
+	for ( std::map< unsigned short, PortCounts >::const_iterator it = ports_.begin(); it != ports_.end(); ++it ) {
+		std::cout << "  0x" << std::setw( 4 ) << it->first << std::setfill( ' ' ) << std::left << ' ' << std::setw( 19 ) << port_name( it->first ) << std::right << std::dec;
+		for ( size_t op = 0; op < OP_CNT; ++op ) {
+			if ( it->second.op[op] ) std::cout << ' ' << OP_NAMES[op] << ' ' << it->second.op[op];
+		}
+		std::cout << '\n' << std::hex << std::setfill( '0' );
+	}
+	
+	// the trace gets long, so only when debugging
+	if ( debug ) {
+		const unsigned long long cnt = std::min< unsigned long long >( accesses_, TRACE );
+		std::cout << std::dec << "last " << cnt << " accesses:\n";
+		for ( unsigned long long i = accesses_ - cnt; i < accesses_; ++i ) {
+			const Access& access = trace_[ i % TRACE ];
+			std::cout << std::dec << std::setfill( ' ' ) << std::fixed << std::setprecision( 6 )
+				<< "  " << std::setw( 12 ) << access.ns / 1000000000.0 << "s " << std::setw( 4 ) << OP_NAMES[ access.op ]
+				<< std::hex << std::setfill( '0' ) << " 0x" << std::setw( 4 ) << access.port
+				<< " 0x" << std::setw( ( OP_INL == access.op || OP_OUTL == access.op ) ? 8 : 2 ) << access.val
+				<< ' ' << port_name( access.port ) << '\n';
+		}
+	}
+	
+	std::cout.flags( flags );
+	std::cout.precision( precision );
+	std::cout.fill( fill );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// what reading a port gets
+unsigned int SimulatedChipset::read_( unsigned short port, bool dword ) {
+	const unsigned int floating = ( dword ) ? 0xFFFFFFFF : 0xFF; // nothing driving the bus
+	
+	if ( PCI_CONFIG_ADDRESS == port ) return pci_address_;
+	if ( PCI_CONFIG_DATA == port ) {
+		// only the LPC bridge is there
+		if ( PCI_LPC_VENDOR_ID == pci_address_ ) return did_vid_;
+		if ( PCI_LPC_GPIOBASE  == pci_address_ ) return GPIOBASE | 0x1;
+		return floating;
+	}
+	
+	for ( size_t chip = 0; chip < 2; ++chip ) {
+		if ( SIO_PORTS[chip] != port && SIO_PORTS[chip] + 1 != port ) continue;
+		if ( SIO_PORTS[chip] != 0x2e && SIO_PORTS[chip] != sio_port_ ) break;
+		if ( SIO_PORTS[chip] == port ) return sio_index_[chip];
+		return ( sio_config_[chip] ) ? sioRead_( chip ) : floating;
+	}
+	
+	if ( port >= GPIOBASE && port < GPIOBASE + GPIO_REGS * 4 ) {
+		const unsigned int reg = gpio_[ ( port - GPIOBASE ) / 4 ];
+		return ( dword ) ? reg : ( reg >> ( ( port % 4 ) * 8 ) ) & 0xFF;
+	}
+	
+	if ( port >= RUNTIME_BASE && port < RUNTIME_BASE + RUNTIME_REGS ) {
+		const unsigned int offset = port - RUNTIME_BASE;
+		return ( HWM_DATA == offset ) ? hwm_[ runtime_[HWM_INDEX] ] : runtime_[offset];
+	}
+	
+	++unclaimed_;
+	return floating;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// what writing a port does
+void SimulatedChipset::write_( unsigned short port, unsigned int val, bool dword ) {
+	if ( PCI_CONFIG_ADDRESS == port ) {
+		pci_address_ = val;
+		return;
+	}
+	if ( PCI_CONFIG_DATA == port ) return; // nothing we model is writable
+	
+	for ( size_t chip = 0; chip < 2; ++chip ) {
+		if ( SIO_PORTS[chip] != port && SIO_PORTS[chip] + 1 != port ) continue;
+		if ( SIO_PORTS[chip] != 0x2e && SIO_PORTS[chip] != sio_port_ ) break;
+		sioWrite_( chip, port, val );
+		return;
+	}
+	
+	if ( port >= GPIOBASE && port < GPIOBASE + GPIO_REGS * 4 ) {
+		unsigned int& reg = gpio_[ ( port - GPIOBASE ) / 4 ];
+		if ( dword ) {
+			reg = val;
+		} else {
+			const unsigned int shift = ( port % 4 ) * 8;
+			reg = ( reg & ~( 0xFFU << shift ) ) | ( ( val & 0xFF ) << shift );
+		}
+		return;
+	}
+	
+	if ( port >= RUNTIME_BASE && port < RUNTIME_BASE + RUNTIME_REGS ) {
+		const unsigned int offset = port - RUNTIME_BASE;
+		if ( HWM_DATA == offset ) {
+			hwm_[ runtime_[HWM_INDEX] ] = val;
+		} else {
+			runtime_[offset] = val;
+		}
+		return;
+	}
+	
+	++unclaimed_;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// read the selected SuperI/O configuration register
+unsigned int SimulatedChipset::sioRead_( size_t chip ) {
+	switch ( sio_index_[chip] ) {
+	case SIO_LDN:	return sio_ldn_;
+	case 0x20:		return SIO_DEVICE_ID;
+	case 0x26:		return sio_port_ & 0xFF;	// where the configuration port is
+	case 0x60:		return ( SIO_RUNTIME_LDN == sio_ldn_ ) ? RUNTIME_BASE >> 8   : 0;
+	case 0x61:		return ( SIO_RUNTIME_LDN == sio_ldn_ ) ? RUNTIME_BASE & 0xFF : 0;
+	default:		return 0;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// write a SuperI/O configuration port
+void SimulatedChipset::sioWrite_( size_t chip, unsigned short port, unsigned int val ) {
+	// index port: entering/leaving configuration mode or selecting a register
+	if ( SIO_PORTS[chip] == port ) {
+		if ( SIO_ENTER == val ) {
+			sio_config_[chip] = true;
+		} else if ( SIO_EXIT == val ) {
+			sio_config_[chip] = false;
+		} else if ( sio_config_[chip] ) {
+			sio_index_[chip] = val;
+		}
+		return;
+	}
+	
+	// data port: only the logical device selection matters to us
+	if ( sio_config_[chip] && SIO_LDN == sio_index_[chip] ) sio_ldn_ = val;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// count and trace an access
+void SimulatedChipset::record_( Op op, unsigned short port, unsigned int val ) {
+	const unsigned int width = ( OP_INL == op || OP_OUTL == op ) ? 4 : 1;
+	for ( unsigned int i = 0; i < width; ++i ) {
+		const unsigned int p = port + i;
+		if ( p >= 0x10000 || !( perm_[ p / 8 ] & ( 1U << ( p % 8 ) ) ) ) {
+			++faults_;
+			break;
+		}
+	}
+	
+	++ports_[port].op[op];
+	
+	Access& access = trace_[ accesses_ % TRACE ];
+	access.ns = monotonic_ns( ) - start_ns_;
+	access.val = val;
+	access.port = port;
+	access.op = op;
+	++accesses_;
+}
@@ -0,0 +1,146 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file simulated_chipset.h
+///
+/// Simulated ICH9/SCH5127 register file for running without the hardware
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_SIMULATED_CHIPSET
+#define INCLUDED_SIMULATED_CHIPSET
+
+//- includes
+#include "port_io.h"
+#include <map>
+#include <stddef.h>
+
+/////////////////////////////////////////////////////////////////////////////
+/// simulated ICH/SCH5127 chipset, for running without the NAS
+///
+/// Answers just enough for the LED drivers to probe and drive it:
+///  - PCI configuration reads (0xCF8/0xCFC) of the LPC bridge's device and
+///    vendor id and GPIOBASE
+///  - the SuperI/O configuration sequence at 0x2e (and 0x4e): enter, chip
+///    id, config port, logical device 0x0a runtime register base, exit
+///  - the ICH GPIO registers (GPIO_USE_SEL, GP_IO_SEL, GP_LVL, GPO_BLINK
+///    and their [60:32] counterparts)
+///  - the SCH5127 runtime registers (GP1..GP6, watchdog) and the hardware
+///    monitor through its index/data pair
+///
+/// Every access is counted per port and timestamped into a trace of the
+/// most recent ones, and accesses to ports without Perm() are counted as
+/// faults (they would kill the process on the real thing).
+class SimulatedChipset : public PortIo {
+public:
+	/// where the simulated chipset decodes things
+	enum {
+		GPIOBASE		= 0x1180,	///< ICH GPIO registers
+		RUNTIME_BASE	= 0x0A00,	///< SCH5127 runtime registers
+		SIO_DEVICE_ID	= 0x86,		///< SCH5127 device id
+		TRACE			= 256,		///< accesses kept in the trace
+	};
+	
+	/// @param did_vid LPC bridge device and vendor id (e.g. 0x29168086 for an ICH9R)
+	/// @param sio_port SuperI/O configuration port (0x2e or 0x4e)
+	explicit SimulatedChipset( unsigned int did_vid, unsigned int sio_port = 0x2e );
+	
+	virtual int Perm( unsigned long from, unsigned long num, int turn_on );
+	virtual unsigned char InB( unsigned short port );
+	virtual unsigned int InL( unsigned short port );
+	virtual void OutB( unsigned char val, unsigned short port );
+	virtual void OutL( unsigned int val, unsigned short port );
+	
+	/// accesses so far
+	unsigned long long Accesses( ) const { return accesses_; }
+	
+	/// value of an ICH GPIO register (GP_LVL etc, offset from GPIOBASE)
+	unsigned int Gpio( unsigned int offset ) const { return gpio_[ ( offset / 4 ) % GPIO_REGS ]; }
+	
+	/// value of an SCH5127 runtime register (offset from RUNTIME_BASE)
+	unsigned char Runtime( unsigned int offset ) const { return runtime_[ offset % RUNTIME_REGS ]; }
+	
+	/// print access counts per port and the most recent accesses
+	void Report( ) const;
+	
+private:
+	enum {
+		GPIO_REGS		= 0x40 / 4,	///< 32 bit ICH GPIO registers
+		RUNTIME_REGS	= 0x80,		///< SCH5127 runtime registers
+		HWM_INDEX		= 0x70,		///< hardware monitor index (runtime register)
+		HWM_DATA		= 0x71,		///< hardware monitor data (runtime register)
+		SIO_LDN			= 0x07,		///< logical device number (configuration register)
+		SIO_RUNTIME_LDN	= 0x0a,		///< logical device holding the runtime register base
+		SIO_ENTER		= 0x55,		///< enter configuration mode
+		SIO_EXIT		= 0xaa,		///< exit configuration mode
+	};
+	
+	/// kinds of access
+	enum Op {
+		OP_INB	= 0,
+		OP_INL,
+		OP_OUTB,
+		OP_OUTL,
+		OP_CNT,
+	};
+	
+	/// one access
+	struct Access {
+		unsigned long long	ns;		///< since the chipset was created
+		unsigned int		val;	///< value read or written
+		unsigned short		port;
+		unsigned char		op;		///< Op
+	};
+	
+	/// accesses to one port
+	struct PortCounts {
+		PortCounts( );
+		unsigned long long	op[OP_CNT];	///< by kind
+	};
+	
+	unsigned int read_( unsigned short port, bool dword );
+	void write_( unsigned short port, unsigned int val, bool dword );
+	unsigned int sioRead_( size_t chip );
+	void sioWrite_( size_t chip, unsigned short port, unsigned int val );
+	void record_( Op op, unsigned short port, unsigned int val );
+	
+	unsigned int		did_vid_;			///< LPC bridge device and vendor id
+	unsigned int		sio_port_;			///< SuperI/O configuration port
+	unsigned int		pci_address_;		///< last written to CONFIG_ADDRESS
+	bool				sio_config_[2];		///< in configuration mode (at 0x2e, 0x4e)?
+	unsigned char		sio_index_[2];		///< selected configuration register (at 0x2e, 0x4e)
+	unsigned char		sio_ldn_;			///< selected logical device
+	unsigned int		gpio_[GPIO_REGS];	///< ICH GPIO registers
+	unsigned char		runtime_[RUNTIME_REGS];	///< SCH5127 runtime registers
+	unsigned char		hwm_[256];			///< hardware monitor registers
+	unsigned char		perm_[ 0x10000 / 8 ];	///< ports we've been given access to (bit per port)
+	
+	unsigned long long	start_ns_;			///< when we were created
+	unsigned long long	accesses_;			///< accesses so far
+	unsigned long long	faults_;			///< accesses to ports without permission
+	unsigned long long	unclaimed_;			///< accesses to ports nothing decodes
+	std::map< unsigned short, PortCounts >	ports_;	///< accesses by port
+	Access				trace_[TRACE];		///< most recent accesses (ring)
+};
+
+#endif // INCLUDED_SIMULATED_CHIPSET
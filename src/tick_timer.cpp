@@ -0,0 +1,175 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file tick_timer.cpp
+///
+/// Drift free periodic ticks using timerfd
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+//- includes
+#include "tick_timer.h"
+#include "errno_exception.h"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+/////////////////////////////////////////////////////////////////////////////
+/// monotonic clock in nanoseconds
+static unsigned long long monotonic_ns( ) {
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return (unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// constructor
+TickTimer::TickTimer( )
+	:	fd_( -1 )
+	,	period_ns_( 0 )
+	,	deadline_ns_( 0 )
+	,	ticks_( 0 )
+	,	overruns_( 0 )
+	,	last_lateness_us_( 0 )
+{
+	std::fill( histogram_, histogram_ + BUCKETS, 0 );
+	fd_ = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC );
+	if ( fd_ < 0 ) throw ErrnoException( "timerfd_create" );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// destructor
+TickTimer::~TickTimer( ) {
+	close( fd_ );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// start ticking every period_ms, first tick one period from now
+void TickTimer::Start( int period_ms ) {
+	period_ns_ = (unsigned long long)period_ms * 1000000ULL;
+	deadline_ns_ = monotonic_ns( ) + period_ns_;
+	arm_( );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// change the period, taking effect from the last tick
+void TickTimer::SetPeriod( int period_ms ) {
+	const unsigned long long period_ns = (unsigned long long)period_ms * 1000000ULL;
+	if ( period_ns == period_ns_ ) return;
+	
+	// move the pending deadline onto the new grid
+	const unsigned long long last_ns = deadline_ns_ - period_ns_;
+	const unsigned long long now_ns = monotonic_ns( );
+	period_ns_ = period_ns;
+	deadline_ns_ = std::max( last_ns + period_ns_, now_ns );
+	arm_( );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// stop ticking
+void TickTimer::Stop( ) {
+	period_ns_ = 0;
+	
+	const struct itimerspec spec = { { 0, 0 }, { 0, 0 } };
+	if ( timerfd_settime( fd_, 0, &spec, 0 ) ) throw ErrnoException( "timerfd_settime" );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// acknowledge a tick once Fd() is readable
+bool TickTimer::Expired( ) {
+	unsigned long long expirations = 0;
+	if ( sizeof(expirations) != read( fd_, &expirations, sizeof(expirations) ) ) {
+		if ( EAGAIN == errno ) return false;
+		throw ErrnoException( "read(timerfd)" );
+	}
+	if ( !period_ns_ ) return false; // stopped
+	
+	// how late are we and did we miss any ticks completely?
+	const unsigned long long now_ns = monotonic_ns( );
+	const unsigned long long late_ns = ( now_ns > deadline_ns_ ) ? now_ns - deadline_ns_ : 0;
+	const unsigned long long missed = late_ns / period_ns_;
+	
+	last_lateness_us_ = (unsigned int)std::min( late_ns / 1000, 0xFFFFFFFFULL );
+	lateness_us_[ ticks_ % HISTORY ] = last_lateness_us_;
+	++histogram_[ ( last_lateness_us_ ) ? 32 - __builtin_clz( last_lateness_us_ ) : 0 ];
+	++ticks_;
+	overruns_ += missed;
+	
+	// next deadline stays on the grid
+	deadline_ns_ += ( missed + 1 ) * period_ns_;
+	arm_( );
+	
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// print tick lateness percentiles for the recent ticks
+void TickTimer::Report( const char* name ) const {
+	const size_t cnt = std::min<unsigned long long>( ticks_, HISTORY );
+	if ( !cnt ) return;
+	
+	unsigned int sorted[HISTORY];
+	std::copy( lateness_us_, lateness_us_ + cnt, sorted );
+	std::sort( sorted, sorted + cnt );
+	
+	std::cout << name << " tick lateness over " << cnt << " ticks:"
+		<< " p50 " << sorted[ cnt / 2 ] << "us"
+		<< " p99 " << sorted[ ( cnt * 99 ) / 100 ] << "us"
+		<< " max " << sorted[ cnt - 1 ] << "us"
+		<< ", " << overruns_ << " overruns\n";
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// print a histogram of tick lateness over every tick so far
+void TickTimer::ReportHistogram( const char* name ) const {
+	if ( !ticks_ ) return;
+	
+	const std::ios::fmtflags flags = std::cout.flags( );
+	const std::streamsize precision = std::cout.precision( );
+	
+	std::cout << name << " tick lateness histogram over " << ticks_ << " ticks:\n";
+	for ( size_t i = 0; i < BUCKETS; ++i ) {
+		if ( !histogram_[i] ) continue;
+		
+		const unsigned long long lo = ( i ) ? 1ULL << ( i - 1 ) : 0;
+		const unsigned long long hi = ( i ) ? ( 1ULL << i ) - 1 : 0;
+		std::cout << "  " << std::setw( 10 ) << lo << " - " << std::setw( 10 ) << hi << "us: "
+			<< histogram_[i] << " (" << std::fixed << std::setprecision( 2 ) << 100.0 * histogram_[i] / ticks_ << "%)\n";
+	}
+	
+	std::cout.flags( flags );
+	std::cout.precision( precision );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// arm the timer for the next deadline
+void TickTimer::arm_( ) {
+	struct itimerspec spec = { { 0, 0 }, { 0, 0 } };
+	spec.it_value.tv_sec  = deadline_ns_ / 1000000000ULL;
+	spec.it_value.tv_nsec = deadline_ns_ % 1000000000ULL;
+	if ( timerfd_settime( fd_, TFD_TIMER_ABSTIME, &spec, 0 ) ) throw ErrnoException( "timerfd_settime" );
+}
@@ -0,0 +1,103 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file tick_timer.h
+///
+/// Drift free periodic ticks using timerfd
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_TICK_TIMER
+#define INCLUDED_TICK_TIMER
+
+//- includes
+#include <stddef.h>
+
+/////////////////////////////////////////////////////////////////////////////
+/// drift free periodic ticks using timerfd
+///
+/// Deadlines are absolute CLOCK_MONOTONIC times on a fixed grid, so time
+/// spent handling other events never stretches the period. Ticks we were too
+/// late for are counted as overruns rather than being silently absorbed.
+class TickTimer {
+public:
+	TickTimer( );
+	~TickTimer( );
+	
+	/// start ticking every period_ms, first tick one period from now
+	void Start( int period_ms );
+	
+	/// change the period, taking effect from the last tick
+	void SetPeriod( int period_ms );
+	
+	/// stop ticking
+	void Stop( );
+	
+	/// ticking?
+	bool Running( ) const { return 0 != period_ns_; }
+	
+	/// file descriptor to wait on for the next tick
+	int Fd( ) const { return fd_; }
+	
+	/// acknowledge a tick once Fd() is readable
+	/// @return false if the timer hasn't actually expired yet
+	bool Expired( );
+	
+	/// number of ticks so far
+	unsigned long long Ticks( ) const { return ticks_; }
+	
+	/// number of ticks missed because we were too late
+	unsigned long long Overruns( ) const { return overruns_; }
+	
+	/// lateness of the most recent tick (microseconds)
+	unsigned int Lateness( ) const { return last_lateness_us_; }
+	
+	/// print tick lateness percentiles for the recent ticks
+	void Report( const char* name ) const;
+	
+	/// print a histogram of tick lateness over every tick so far
+	void ReportHistogram( const char* name ) const;
+	
+private:
+	enum {
+		HISTORY	= 1024,	///< number of recent ticks we keep lateness for
+		BUCKETS	= 33,	///< log2 lateness buckets (0us, 1us, 2-3us, 4-7us, ...)
+	};
+	
+	void arm_( );
+	
+	int					fd_;				///< timerfd
+	unsigned long long	period_ns_;			///< tick period
+	unsigned long long	deadline_ns_;		///< next deadline (CLOCK_MONOTONIC)
+	unsigned long long	ticks_;				///< ticks so far
+	unsigned long long	overruns_;			///< ticks missed
+	unsigned int		last_lateness_us_;	///< lateness of the most recent tick
+	unsigned int		lateness_us_[HISTORY];	///< lateness of recent ticks
+	unsigned long long	histogram_[BUCKETS];	///< lateness of every tick (log2 buckets)
+	
+	// no copying
+	TickTimer( const TickTimer& rhs );
+	const TickTimer& operator=( const TickTimer& rhs );
+};
+
+#endif // INCLUDED_TICK_TIMER
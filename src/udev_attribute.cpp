@@ -0,0 +1,52 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file udev_attribute.cpp
+///
+/// Reading sysfs attributes through udev
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+//- includes
+#include "udev_attribute.h"
+#include <algorithm>
+#include <cctype>
+#include <functional>
+#include <libudev.h>
+
+/////////////////////////////////////////////////////////////////////////////
+// get attribute from udev device specified by subsytem an device name
+std::string GetUdevDeviceAttribute(udev *udev, const char *subsystem, const char *sysname, const char *sysattr) {
+	udev_device *device = udev_device_new_from_subsystem_sysname(udev, subsystem, sysname);
+	if (!device) return std::string();
+	
+	const char *attr = udev_device_get_sysattr_value(device, sysattr);
+	std::string value(attr ? attr : "");
+	value.erase(value.begin(), std::find_if(value.begin(), value.end(), std::not1(std::ptr_fun<int, int>(std::isspace))));
+	value.erase(std::find_if(value.rbegin(), value.rend(), std::not1(std::ptr_fun<int, int>(std::isspace))).base(), value.end());
+	//free
+	udev_device_unref(device);
+	
+	return value;
+}
@@ -37,212 +37,621 @@
  * 3. This notice may not be removed or altered from any source
  *    distribution.
  */
-
+#include <algorithm>
 #include <iostream>
 #include <fstream>
-#include <pthread.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/select.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
 
 #include "errno_exception.h"
 #include "mediasmartserverd.h"
 #include "update_monitor.h"
 
+/**
+ * Files whose changes affect the update status.
+ * Directories are watched rather than the files themselves, since apt and
+ * dpkg replace files by renaming new ones over them.
+ */
+static const struct
+{
+	const char* dir;       ///< Directory to watch.
+	const char* name;      ///< File of interest in it (NULL for any).
+	bool packages;         ///< Whether changes mean the package counts need redoing.
+} kWatched[] =
+{
+	{ "/var/lib/apt/lists",    NULL,              true  },
+	{ "/var/lib/dpkg",         "status",          true  },
+	{ "/var/lib/apt/periodic", NULL,              true  },
+	{ "/var/run",              "reboot-required", false },
+};
+static const size_t kWatchedCount = sizeof(kWatched) / sizeof(kWatched[0]);
+
+/** Events that count as a change. */
+static const uint32_t kWatchMask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_TO | IN_MOVED_FROM | IN_ATTRIB;
+
+/** Quiet time after the last change before re-evaluating (apt and dpkg write in bursts). */
+static const int kDebounceMs = 2000;
+
+/** Longest a steady stream of changes can put off re-evaluating. */
+static const int kMaxDebounceMs = 60000;
+
+/** Longest apt-check may run before it's killed. */
+static const int kAptCheckTimeoutMs = 120000;
+
+/** Address space apt-check may use (python and the apt cache fit easily). */
+static const size_t kAptCheckMemLimit = 1024 * 1024 * 1024;
+
+/** Re-evaluate this often regardless, in case a change was missed (s). */
+static const int kSafetyIntervalS = 6 * 60 * 60;
+
+/** How often to re-evaluate if nothing can be watched (s). */
+static const int kPollIntervalS = 900;
+
+/** Longest counting natively may take before it's killed. */
+static const int kNativeCountTimeoutMs = 30000;
+
+/** Address space counting natively may use (the lists are mapped, not copied). */
+static const size_t kNativeCountMemLimit = 256 * 1024 * 1024;
+
+/** apt-check from update-notifier-common. */
+static const char* const kAptCheckArgv[] = { "/usr/lib/update-notifier/apt-check", NULL };
+
+/**
+ * Current time on the monotonic clock.
+ * @return Milliseconds.
+ */
+static unsigned long long MonotonicMs()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
 /***********************************************************
 * Public                                                   *
 ***********************************************************/
 /**
  * Constructor (explicit).
- * Initialize the LED control interface.
- * @param leds LED control interface needed for accessing LEDs.
+ * Initialize the LED compositor.
+ * @param compositor LED compositor our system LED status is published to.
  * @public
  */
-UpdateMonitor::UpdateMonitor(const LedControlPtr& leds)
+UpdateMonitor::UpdateMonitor(const LedCompositorPtr& compositor)
+	: compositor_(compositor)
+	, loop_(NULL)
+	, inotify_fd_(-1)
+	, timer_fd_(-1)
+	, watching_(false)
+	, pending_changes_(0)
+	, debounce_deadline_ms_(0)
+	, native_count_(false)
+	, update_count_(-1)
+	, security_update_count_(-1)
 {
-	leds_ = leds;
+	std::fill(watch_descriptors_, watch_descriptors_ + kMaxWatches, -1);
+	apt_check_fds_[0] = apt_check_fds_[1] = -1;
 }
 
 /**
  * Destructor.
- * Stop the thread cleanly if not already done.
+ * Stop monitoring if not already done.
  */
 UpdateMonitor::~UpdateMonitor()
 {
-	if(instance_started_)
-	{
-		Stop();
-	}
+	Stop();
 }
 
 /**
- * Starts the update monitoring thread.
+ * Starts monitoring on an event loop.
+ * @param loop Loop our inotify watches, timer and helpers are handled on.
  * @public
  */
-void UpdateMonitor::Start()
+void UpdateMonitor::Start(EventLoop& loop)
 {
-	if (instance_started_)
+	if (loop_)
 	{
 		if (verbose > 0)
 		{
-			std::cout << "Update monitor thread already running.\n";
+			std::cout << "Update monitor already running.\n";
 		}
 		return;
 	}
-	if (pthread_create(&monitor_thread_, NULL, MonitorThreadProc, NULL) != 0)
+	timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (timer_fd_ < 0)
 	{
-		throw ErrnoException("pthread_create");
+		throw ErrnoException("timerfd_create");
+	}
+	loop_ = &loop;
+	loop_->Add(timer_fd_, this, "update timer");
+	watching_ = AddWatches();
+	if (watching_)
+	{
+		loop_->Add(inotify_fd_, this, "inotify");
 	}
-	instance_started_ = true;
 	if (verbose > 0)
 	{
-		std::cout << "Update monitor thread started.\n";
+		std::cout << "Update monitor started.\n";
 	}
+	Evaluate(CHANGE_PACKAGES | CHANGE_REBOOT);
 }
 
 /**
- * Stops the update monitoring thread.
+ * Stops monitoring, killing apt-check if it's running.
  * @public
  */
 void UpdateMonitor::Stop()
 {
-	if (!instance_started_)
+	if (!loop_)
 	{
-		if (verbose > 0)
+		return;
+	}
+	apt_check_.Kill();
+	native_count_ = false;
+	for (size_t i = 0; i < 2; ++i)
+	{
+		if (apt_check_fds_[i] >= 0)
 		{
-			std::cout << "Update monitor thread already stopped.\n";
+			loop_->Remove(apt_check_fds_[i]);
+			apt_check_fds_[i] = -1;
 		}
-		return;
 	}
+	if (inotify_fd_ >= 0)
+	{
+		loop_->Remove(inotify_fd_);
+		close(inotify_fd_);
+		inotify_fd_ = -1;
+	}
+	loop_->Remove(timer_fd_);
+	close(timer_fd_);
+	timer_fd_ = -1;
+	loop_ = NULL;
+	//Reset LED.
+	compositor_->Clear(LAYER_UPDATE);
+	compositor_->Commit();
 	if (verbose > 0)
 	{
-		std::cout << "Attempting to stop update monitor thread.\n";
+		std::cout << "Update monitor stopped.\n";
+	}
+}
+
+/**
+ * Handles inotify events, timer expiry and apt-check output or exit.
+ * @param fd File descriptor that's ready.
+ * @param events Required by definition but not used.
+ * @public
+ */
+void UpdateMonitor::OnEvent(int fd, unsigned int /*events*/)
+{
+	if (fd == inotify_fd_)
+	{
+		const int changes = ReadChanges();
+		if (changes == 0)
+		{
+			return;
+		}
+		pending_changes_ |= changes;
+		//Picked up once apt-check finishes.
+		if (apt_check_.Running())
+		{
+			return;
+		}
+		//Let the burst (apt update, dpkg run) finish before looking.
+		const unsigned long long now = MonotonicMs();
+		if (debounce_deadline_ms_ == 0)
+		{
+			debounce_deadline_ms_ = now + kMaxDebounceMs;
+		}
+		ArmTimer(std::min<unsigned long long>(kDebounceMs, debounce_deadline_ms_ > now ? debounce_deadline_ms_ - now : 0));
+	}
+	else if (fd == timer_fd_)
+	{
+		uint64_t expirations;
+		if (read(timer_fd_, &expirations, sizeof(expirations)) != sizeof(expirations))
+		{
+			return;
+		}
+		if (apt_check_.Running())
+		{
+			//Its deadline.
+			PollAptCheck();
+		}
+		else if (debounce_deadline_ms_ != 0)
+		{
+			//Things went quiet.
+			const int changes = pending_changes_;
+			pending_changes_ = 0;
+			debounce_deadline_ms_ = 0;
+			if (verbose > 1)
+			{
+				std::cout << "Update monitor woken by changes to"
+					<< ((changes & CHANGE_PACKAGES) ? " packages" : "")
+					<< ((changes & CHANGE_REBOOT) ? " reboot-required" : "") << "\n";
+			}
+			Evaluate(changes);
+		}
+		else
+		{
+			//Periodic re-check.
+			Evaluate(CHANGE_PACKAGES | CHANGE_REBOOT);
+		}
 	}
-	//Cancelling thread.
-	if(pthread_cancel(monitor_thread_) != 0)
+	else if (fd == apt_check_fds_[0] || fd == apt_check_fds_[1])
 	{
-		throw ErrnoException("pthread_cancel");
+		PollAptCheck();
 	}
-	//Waiting for thread to join.
-	if(pthread_join(monitor_thread_, NULL) != 0)
+}
+
+/**
+ * Checks for available system updates by running apt-check, waiting for it.
+ * @param[out] update_count Returns number of avaiable updates.
+ * @param[out] security_update_count Returns number of available security updates.
+ * @return Returns true if information could be read.
+ * @public @static
+ */
+bool UpdateMonitor::RunAptCheck(int* update_count, int* security_update_count)
+{
+	HelperProcess apt_check;
+	if (!apt_check.Start(kAptCheckArgv, kAptCheckTimeoutMs, kAptCheckMemLimit))
 	{
-		throw ErrnoException("pthread_join");
+		if (verbose > 1)
+		{
+			std::cout << "apt-check does not exist or can't be run: " << strerror(errno) << "\n";
+		}
+		return false;
 	}
-	if (verbose > 0)
+	while (!apt_check.Poll())
 	{
-		std::cout << "Update monitor thread stopped.\n";
+		fd_set fds;
+		FD_ZERO(&fds);
+		int nfds = 0;
+		const int wait_fds[2] = { apt_check.OutputFd(), apt_check.ExitFd() };
+		for (size_t i = 0; i < 2; ++i)
+		{
+			if (wait_fds[i] >= 0)
+			{
+				FD_SET(wait_fds[i], &fds);
+				nfds = std::max(nfds, wait_fds[i] + 1);
+			}
+		}
+		const int wait_ms = apt_check.WaitMs();
+		timeval tv = { wait_ms / 1000, (wait_ms % 1000) * 1000 };
+		select(nfds, &fds, NULL, NULL, &tv);
+	}
+	if (apt_check.TimedOut())
+	{
+		std::cout << "apt-check took longer than " << kAptCheckTimeoutMs / 1000 << "s, killed it.\n";
+		return false;
 	}
+	return ParseAptCheck(apt_check.Output(), update_count, security_update_count);
 }
 
 /***********************************************************
 * Private                                                  *
 ***********************************************************/
 /**
- * Cleans up after the update monitoring thread.
- * @param arg Required by definition but not used.
- * @private @static
+ * Sets up inotify watches on the files affecting the update status.
+ * @return Returns true if anything is being watched.
+ * @private
  */
-void UpdateMonitor::MonitorThreadCleanupHandler(void* /*arg*/)
+bool UpdateMonitor::AddWatches()
 {
-	if (verbose > 0)
+	inotify_fd_ = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+	if (inotify_fd_ < 0)
 	{
-		std::cout << "Cleaning up after the update monitor thread.\n";
+		if (verbose > 0)
+		{
+			std::cout << "inotify unavailable (" << strerror(errno) << "), checking for updates every "
+				<< kPollIntervalS << "s.\n";
+		}
+		return false;
 	}
-	instance_started_ = false;
-	//Reset LED.
-	leds_->SetSystemLed(LED_BLUE | LED_RED, false);
+	bool watching = false;
+	for (size_t i = 0; i < kWatchedCount; ++i)
+	{
+		watch_descriptors_[i] = inotify_add_watch(inotify_fd_, kWatched[i].dir, kWatchMask);
+		if (watch_descriptors_[i] < 0)
+		{
+			if (verbose > 1)
+			{
+				std::cout << "Can't watch " << kWatched[i].dir << ": " << strerror(errno) << "\n";
+			}
+			continue;
+		}
+		watching = true;
+	}
+	if (!watching && verbose > 0)
+	{
+		std::cout << "Nothing to watch, checking for updates every " << kPollIntervalS << "s.\n";
+	}
+	return watching;
 }
 
 /**
- * The thread monitoring the update status and setting the system LED.
- * @param arg Required by definition but not used.
- * @private @static
+ * Reads pending inotify events.
+ * @return Returns what the events changed (CHANGE_ flags).
+ * @private
  */
-void* UpdateMonitor::MonitorThreadProc(void* /*arg*/)
+int UpdateMonitor::ReadChanges()
 {
-	pthread_cleanup_push(MonitorThreadCleanupHandler, NULL);
+	int changes = 0;
+	char buf[4096] __attribute__((aligned(__alignof__(inotify_event))));
 	while(true)
 	{
-		if (pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL) != 0)
+		ssize_t len = read(inotify_fd_, buf, sizeof(buf));
+		if (len <= 0)
 		{
-			throw ErrnoException("pthread_setcancelstate");
+			break;
 		}
-		int update_count = -1, security_update_count = -1;
-		if(!GetUpdateStatus(&update_count, &security_update_count))
+		for (char* ptr = buf; ptr < buf + len; )
 		{
-			break;
+			const inotify_event* event = (const inotify_event*)ptr;
+			ptr += sizeof(inotify_event) + event->len;
+			if (event->mask & IN_Q_OVERFLOW)
+			{
+				//Lost track, redo everything.
+				changes |= CHANGE_PACKAGES | CHANGE_REBOOT;
+				continue;
+			}
+			for (size_t i = 0; i < kWatchedCount; ++i)
+			{
+				if (event->wd != watch_descriptors_[i])
+				{
+					continue;
+				}
+				if (kWatched[i].name && (event->len == 0 || strcmp(event->name, kWatched[i].name) != 0))
+				{
+					continue;
+				}
+				if (event->len != 0 && strcmp(event->name, "lock") == 0)
+				{
+					//apt takes its lock whether or not it changes anything.
+					continue;
+				}
+				changes |= kWatched[i].packages ? CHANGE_PACKAGES : CHANGE_REBOOT;
+			}
 		}
-		bool reboot_required = IsRebootRequired();
-		if (verbose > 1)
+	}
+	return changes;
+}
+
+/**
+ * Arms the timer to go off once.
+ * @param delay_ms How long from now.
+ * @private
+ */
+void UpdateMonitor::ArmTimer(unsigned long long delay_ms)
+{
+	//An all zero it_value would disarm it instead.
+	delay_ms = std::max<unsigned long long>(delay_ms, 1);
+	itimerspec its;
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = delay_ms / 1000;
+	its.it_value.tv_nsec = (delay_ms % 1000) * 1000000;
+	if (timerfd_settime(timer_fd_, 0, &its, NULL) != 0)
+	{
+		throw ErrnoException("timerfd_settime");
+	}
+}
+
+/**
+ * Works out the update status after something changed.
+ * Starts apt-check and finishes once it's done, or with --native-updates
+ * counts from the dpkg status and apt lists, falling back on apt-check.
+ * Either way the counting happens in a helper process, off the loop.
+ * @param changes What changed (CHANGE_ flags).
+ * @private
+ */
+void UpdateMonitor::Evaluate(int changes)
+{
+	if (changes & CHANGE_PACKAGES)
+	{
+		if (update_native)
 		{
-			std::cout << "--- Update Monitor ---\n";
-			std::cout << "  Updates          : " << update_count << "\n"; 
-			std::cout << "  Security Updates : " << security_update_count << "\n";
-			std::cout << "  Reboot Required  : " << (reboot_required ? "YES" : "NO") << "\n";
+			StartNativeCount();
 		}
-		if (reboot_required)
+		if (!apt_check_.Running())
 		{
-			//Red
-			leds_->SetSystemLed(LED_RED, true);
-			leds_->SetSystemLed(LED_BLUE, false);
+			StartAptCheck();
 		}
-		else if (security_update_count > 0)
+		if (apt_check_.Running())
 		{
-			//Purple
-			leds_->SetSystemLed(LED_BLUE | LED_RED, true);
+			return;
 		}
-		else if (update_count > 0)
+	}
+	FinishChecking();
+}
+
+/**
+ * Starts our own binary counting updates natively (--count-updates),
+ * watching its output and exit on the loop.
+ * Mapping and parsing every package list takes too long to do on the loop.
+ * @private
+ */
+void UpdateMonitor::StartNativeCount()
+{
+	//Resolved here, the shell setting the memory limit has its own /proc/self.
+	char self[PATH_MAX];
+	const ssize_t len = readlink("/proc/self/exe", self, sizeof(self) - 1);
+	if (len <= 0)
+	{
+		return;
+	}
+	self[len] = '\0';
+	const char* const argv[] = { self, "--count-updates", NULL };
+	if (!apt_check_.Start(argv, kNativeCountTimeoutMs, kNativeCountMemLimit))
+	{
+		if (verbose > 1)
 		{
-			//Blue
-			leds_->SetSystemLed(LED_BLUE, true);
-			leds_->SetSystemLed(LED_RED, false);
+			std::cout << "Couldn't count updates natively (" << strerror(errno) << "), trying apt-check.\n";
 		}
-		else //Nothing
+		return;
+	}
+	native_count_ = true;
+	WatchHelper("count-updates");
+}
+
+/**
+ * Starts apt-check running, watching its output and exit on the loop.
+ * @private
+ */
+void UpdateMonitor::StartAptCheck()
+{
+	native_count_ = false;
+	if (!apt_check_.Start(kAptCheckArgv, kAptCheckTimeoutMs, kAptCheckMemLimit))
+	{
+		if (verbose > 1)
 		{
-			//Off
-			leds_->SetSystemLed(LED_BLUE | LED_RED, false);
+			std::cout << "apt-check does not exist or can't be run: " << strerror(errno) << "\n";
 		}
-		if (pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL) != 0)
+		return;
+	}
+	WatchHelper("apt-check");
+}
+
+/**
+ * Watches the helper's output and exit on the loop, and its deadline.
+ * @param name Source name for the loop's stats.
+ * @private
+ */
+void UpdateMonitor::WatchHelper(const char* name)
+{
+	apt_check_fds_[0] = apt_check_.OutputFd();
+	apt_check_fds_[1] = apt_check_.ExitFd();
+	for (size_t i = 0; i < 2; ++i)
+	{
+		if (apt_check_fds_[i] >= 0)
 		{
-			throw ErrnoException("pthread_setcancelstate");
+			loop_->Add(apt_check_fds_[i], this, name);
 		}
-		sleep(900); //Sleep 15 minutes. //A cancellation point.
 	}
-	std::cout << "Update monitor thread stopped from within monitoring loop.\n";
-	pthread_cleanup_pop(1); //Remove handler and execute it.
-	return NULL;
+	ArmTimer(apt_check_.WaitMs());
 }
 
 /**
- * Checks for available system updates.
- * Uses update-notifier-common to check for updates via apt-check.
- * @param[out] update_count Returns number of avaiable updates.
- * @param[out] security_update_count Returns number of available security updates.
- * @return Returns true if information could be read.
- * @private @static
+ * Collects the helper's output, finishing up once it's exited (or overrun).
+ * If counting natively failed, apt-check gets a go.
+ * @private
  */
-bool UpdateMonitor::GetUpdateStatus(int* update_count, int* security_update_count)
+void UpdateMonitor::PollAptCheck()
 {
-	//For some reason stderr has the result not stdout so we redirect it to stdout.
-	FILE* apt_check = popen("/usr/lib/update-notifier/apt-check 2>&1", "r");
-	if (apt_check == NULL)
+	const bool finished = apt_check_.Poll();
+	//The helper closes its fds as it finishes with them.
+	const int current_fds[2] = { apt_check_.OutputFd(), apt_check_.ExitFd() };
+	for (size_t i = 0; i < 2; ++i)
+	{
+		if (apt_check_fds_[i] >= 0 && apt_check_fds_[i] != current_fds[i])
+		{
+			loop_->Remove(apt_check_fds_[i]);
+			apt_check_fds_[i] = -1;
+		}
+	}
+	if (!finished)
+	{
+		ArmTimer(apt_check_.WaitMs());
+		return;
+	}
+	if (native_count_)
 	{
+		native_count_ = false;
+		const int status = apt_check_.Status();
+		if (!apt_check_.TimedOut() && WIFEXITED(status) && WEXITSTATUS(status) == 0
+			&& ParseAptCheck(apt_check_.Output(), &update_count_, &security_update_count_))
+		{
+			FinishChecking();
+			return;
+		}
 		if (verbose > 1)
 		{
-			std::cout << "apt-check does not exist or can't be read.\n";
+			std::cout << "Couldn't count updates natively, trying apt-check.\n";
 		}
-		return false;
+		StartAptCheck();
+		if (apt_check_.Running())
+		{
+			return;
+		}
+		update_count_ = security_update_count_ = -1;
+	}
+	else if (apt_check_.TimedOut())
+	{
+		std::cout << "apt-check took longer than " << kAptCheckTimeoutMs / 1000 << "s, killed it.\n";
+	}
+	else if (!ParseAptCheck(apt_check_.Output(), &update_count_, &security_update_count_))
+	{
+		update_count_ = security_update_count_ = -1;
+	}
+	FinishChecking();
+}
+
+/**
+ * Shows the update status on the system LED and waits for the next change.
+ * @private
+ */
+void UpdateMonitor::FinishChecking()
+{
+	bool reboot_required = IsRebootRequired();
+	if (verbose > 1)
+	{
+		std::cout << "--- Update Monitor ---\n";
+		std::cout << "  Updates          : " << update_count_ << "\n"; 
+		std::cout << "  Security Updates : " << security_update_count_ << "\n";
+		std::cout << "  Reboot Required  : " << (reboot_required ? "YES" : "NO") << "\n";
+	}
+	if (reboot_required)
+	{
+		//Red
+		SetSystemLed(LED_RED);
+	}
+	else if (security_update_count_ > 0)
+	{
+		//Purple
+		SetSystemLed(LED_BLUE | LED_RED);
 	}
-	char* line = NULL;
-	size_t len = 0;
-	int res = getline(&line, &len, apt_check);
-	pclose(apt_check);
-	if (res == -1 || len < 3)
+	else if (update_count_ > 0)
+	{
+		//Blue
+		SetSystemLed(LED_BLUE);
+	}
+	else //Nothing
+	{
+		//Off
+		SetSystemLed(0);
+	}
+	//Changes that came in while apt-check was running.
+	if (pending_changes_)
+	{
+		debounce_deadline_ms_ = MonotonicMs() + kMaxDebounceMs;
+		ArmTimer(kDebounceMs);
+		return;
+	}
+	ArmTimer((watching_ ? kSafetyIntervalS : kPollIntervalS) * 1000ULL);
+}
+
+/**
+ * Reads the counts from apt-check's output.
+ * @param output What apt-check wrote ("updates;security updates").
+ * @param[out] update_count Returns number of avaiable updates.
+ * @param[out] security_update_count Returns number of available security updates.
+ * @return Returns true if information could be read.
+ * @private @static
+ */
+bool UpdateMonitor::ParseAptCheck(const std::string& output, int* update_count, int* security_update_count)
+{
+	const std::string line = output.substr(0, output.find('\n'));
+	if (line.length() < 3)
 	{
 		if (verbose > 1)
 		{
-			std::cout << "Couldn't read line. res = " << res << "; len = " << len
-				<< "; line = \"" << line << "\"\n";
+			std::cout << "Couldn't read line. line = \"" << line << "\"\n";
 		}
 		return false;
 	}
@@ -274,13 +683,14 @@ bool UpdateMonitor::IsRebootRequired()
 }
 
 /**
- * LED control interface.
- * @private @static
+ * Publishes the system LED colours to light (committed by the main loop).
+ * @param led_type Colours to light (LED_BLUE, LED_RED or both), the rest are off.
+ * @private
  */
-LedControlPtr UpdateMonitor::leds_; //Assigned in constructor.
-
-/**
- * Helper variable keeping track of thread status.
- * @private @static
- */
-bool UpdateMonitor::instance_started_ = false;
+void UpdateMonitor::SetSystemLed(int led_type)
+{
+	LedFrame frame;
+	frame.SetSystem(led_type, LED_ON);
+	frame.SetSystem(~led_type & (LED_BLUE | LED_RED), LED_OFF);
+	compositor_->Publish(LAYER_UPDATE, frame);
+}
@@ -38,26 +38,58 @@
 #ifndef UPDATE_MONITOR_H_
 #define UPDATE_MONITOR_H_
 
-#include <pthread.h>
+#include <string>
 
-#include "led_control_base.h"
+#include "event_loop.h"
+#include "helper_process.h"
+#include "led_compositor.h"
 
-class UpdateMonitor
+class UpdateMonitor : public EventHandler
 {
 public:
-	explicit UpdateMonitor(const LedControlPtr& leds); //Prevent implicit conversions.
+	explicit UpdateMonitor(const LedCompositorPtr& compositor); //Prevent implicit conversions.
 	~UpdateMonitor();
-	void Start();
+	void Start(EventLoop& loop);
 	void Stop();
+	virtual void OnEvent(int fd, unsigned int events);
+	static bool RunAptCheck(int* update_count, int* security_update_count);
 private:
-	static void MonitorThreadCleanupHandler (void* /*arg*/);
-	static void* MonitorThreadProc (void* /*arg*/);
-	static bool GetUpdateStatus(int* update_count, int* security_update_count);
+	bool AddWatches();
+	int ReadChanges();
+	void ArmTimer(unsigned long long delay_ms);
+	void Evaluate(int changes);
+	void StartNativeCount();
+	void StartAptCheck();
+	void WatchHelper(const char* name);
+	void PollAptCheck();
+	void FinishChecking();
+	void SetSystemLed(int led_type);
+	static bool ParseAptCheck(const std::string& output, int* update_count, int* security_update_count);
 	static bool IsRebootRequired();
 	
-	static LedControlPtr leds_;
-	static bool instance_started_;
-	pthread_t monitor_thread_;
+	/** What a change affects. */
+	enum
+	{
+		CHANGE_PACKAGES = 1 << 0, ///< Package lists or installed packages (recount).
+		CHANGE_REBOOT   = 1 << 1, ///< Reboot required flag.
+	};
+	
+	/** Most directories watched. */
+	enum { kMaxWatches = 8 };
+	
+	LedCompositorPtr compositor_;
+	EventLoop* loop_;                        ///< Loop we're running on (NULL if stopped).
+	int inotify_fd_;                         ///< inotify instance (-1 if none).
+	int timer_fd_;                           ///< Debounce, apt-check deadline and periodic re-checks.
+	int watch_descriptors_[kMaxWatches];     ///< One per watched directory (-1 if not watched).
+	bool watching_;                          ///< Is anything being watched?
+	int pending_changes_;                    ///< Changes not acted on yet.
+	unsigned long long debounce_deadline_ms_; ///< Latest the current burst can put off a re-check (0 if none).
+	HelperProcess apt_check_;                ///< apt-check or the native counter, while it's running.
+	int apt_check_fds_[2];                   ///< Its fds registered with the loop (-1 if none).
+	bool native_count_;                      ///< Is it the native counter (falling back on apt-check)?
+	int update_count_;                       ///< Last update count (-1 if unknown).
+	int security_update_count_;              ///< Last security update count (-1 if unknown).
 	
 	/**
 	 * DISALLOW_COPY_AND_ASSIGN 
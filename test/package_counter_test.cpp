@@ -0,0 +1,152 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file package_counter_test.cpp
+///
+/// Checks of the native update counter against known answers
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+//- includes
+#include "package_counter.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string.h>
+
+/////////////////////////////////////////////////////////////////////////////
+/// a pair of versions and how dpkg --compare-versions orders them
+struct VersionCase {
+	const char*	a;
+	const char*	b;
+	int			order;	///< -1 (a older), 0 (same) or 1 (a newer)
+};
+
+/// every row checked against dpkg 1.21 (dpkg --compare-versions a lt/eq b)
+static const VersionCase VERSION_CASES[] = {
+	// plain numbers
+	{ "1.0",						"1.0",						 0 },
+	{ "1.0",						"1.1",						-1 },
+	{ "1.10",						"1.9",						 1 },
+	{ "1.01",						"1.1",						 0 },
+	{ "10",							"9",						 1 },
+	// epochs
+	{ "1:1.0",						"2.0",						 1 },
+	{ "0:1.0",						"1.0",						 0 },
+	{ "2:0.1",						"1:9.9",					 1 },
+	{ "2:8.2.3995-1ubuntu2",		"8.2.3995-1ubuntu2.1",		 1 },
+	// tilde sorts before anything, even the end
+	{ "1.0~rc1",					"1.0",						-1 },
+	{ "1.0~rc1",					"1.0~rc2",					-1 },
+	{ "1.0~~",						"1.0~",						-1 },
+	{ "1.0~",						"1.0",						-1 },
+	{ "1a~",						"1a",						-1 },
+	{ "7.81.0-1ubuntu1.10~rc1",		"7.81.0-1ubuntu1.10",		-1 },
+	{ "1.0-1",						"1.0-1~bpo1",				 1 },
+	// letters sort before non-letters, and by ASCII among themselves
+	{ "1.0",						"1.0a",						-1 },
+	{ "1.0a",						"1.0+",						-1 },
+	{ "1.0+",						"1.0.",						-1 },
+	{ "1.0z",						"1.0.",						-1 },
+	{ "1.0a",						"1.0A",						 1 },
+	{ "1Z",							"1a",						-1 },
+	{ "1a",							"1",						 1 },
+	{ "1.0+dfsg",					"1.0",						 1 },
+	// revisions (split at the last hyphen)
+	{ "1.0-1",						"1.0-2",					-1 },
+	{ "1.0-1",						"1.0",						 1 },
+	{ "1.0-0",						"1.0",						 0 },
+	{ "1.0-1ubuntu1",				"1.0-1ubuntu1.1",			-1 },
+	{ "1.0-1ubuntu1.10",			"1.0-1ubuntu1.9",			 1 },
+	{ "1.2-3-4",					"1.2-3-5",					-1 },
+	{ "1.2-3-4",					"1.2-4",					 1 },
+	{ "5.1-6ubuntu1",				"5.1-6ubuntu1.1",			-1 },
+	{ "3.0.2-0ubuntu1.12",			"3.0.2-0ubuntu1.10",		 1 },
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// sign of a comparison
+static int sign( int res ) {
+	return ( res > 0 ) - ( res < 0 );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// check debian_version_compare against the table, both ways round
+/// @return failures
+static int check_versions( ) {
+	int failures = 0;
+	for ( size_t i = 0; i < sizeof(VERSION_CASES) / sizeof(VERSION_CASES[0]); ++i ) {
+		const VersionCase& vc = VERSION_CASES[i];
+		const int ab = sign( debian_version_compare( vc.a, strlen( vc.a ), vc.b, strlen( vc.b ) ) );
+		const int ba = sign( debian_version_compare( vc.b, strlen( vc.b ), vc.a, strlen( vc.a ) ) );
+		if ( ab == vc.order && ba == -vc.order ) continue;
+		
+		std::cout << "FAIL: compare " << vc.a << ' ' << vc.b << " gave " << ab << '/' << ba
+			<< ", dpkg says " << vc.order << '\n';
+		++failures;
+	}
+	return failures;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// count a fixture tree and compare with its expected "updates;security" line
+/// @return failures
+static int check_fixture( const std::string& root ) {
+	std::ifstream file( ( root + "/expected" ).c_str() );
+	std::string expected;
+	if ( !std::getline( file, expected ) ) {
+		std::cout << "FAIL: no " << root << "/expected\n";
+		return 1;
+	}
+	
+	PackageCounter counter( root );
+	int updates = 0, security_updates = 0;
+	if ( !counter.Count( updates, security_updates ) ) {
+		std::cout << "FAIL: couldn't count " << root << '\n';
+		return 1;
+	}
+	
+	std::ostringstream got;
+	got << updates << ';' << security_updates;
+	if ( got.str() == expected ) return 0;
+	
+	std::cout << "FAIL: " << root << " counted " << got.str() << ", expected " << expected << '\n';
+	return 1;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// main entry point
+///
+/// Each argument is a fixture tree to count.
+int main( int argc, char* argv[] ) {
+	int failures = check_versions( );
+	for ( int arg = 1; arg < argc; ++arg ) failures += check_fixture( argv[arg] );
+	
+	if ( failures ) {
+		std::cout << failures << " failed\n";
+		return 1;
+	}
+	std::cout << "package counter: all passed\n";
+	return 0;
+}